@@ -383,6 +383,26 @@ def coalesce(logfile, json_filename, iterkey, files, whole_space=False):
   assert not synres.failed, "breadth coalesce failed"
   return new_output_file
 
+def new_shared_cex_log():
+  # Returns a fresh file for the processes of one run to share their
+  # counterexamples through, or None unless --share-cexes was given
+  if not share_cexes:
+    return None
+  f = tempfile.NamedTemporaryFile(prefix="cexlog.", delete=False)
+  f.close()
+  return f.name
+
+def shared_cex_log_args(cex_log):
+  if cex_log == None:
+    return []
+  return ["--shared-cex-log", cex_log]
+
+def remove_shared_cex_log(threads, cex_log):
+  for t in threads:
+    t.join()
+  if cex_log != None:
+    os.remove(cex_log)
+
 def remove_one(s):
   assert len(s) > 0
   t = min(s)
@@ -397,6 +417,10 @@ def breadth_run_in_parallel(iterkey, logfile, json_filename, main_args, invfile,
   else:
     args_with_file = ["--one-breadth"]
 
+  # counterexamples learned by any of the processes are shared with the others
+  cex_log = new_shared_cex_log()
+  args_with_file = args_with_file + shared_cex_log_args(cex_log)
+
   q = queue.Queue()
   threads = [ ]
   output_files = {}
@@ -455,6 +479,8 @@ def breadth_run_in_parallel(iterkey, logfile, json_filename, main_args, invfile,
             any_success = True
             success_file = output_files[key]
 
+  remove_shared_cex_log(threads, cex_log)
+
   if any_success:
     return (True, has_any, success_file)
 
@@ -476,6 +502,10 @@ def do_finisher(iterkey, logfile, nthreads, json_filename, main_args, args, invf
   else:
     args_with_file = ["--one-finisher"]
 
+  # counterexamples learned by any of the processes are shared with the others
+  cex_log = new_shared_cex_log()
+  args_with_file = args_with_file + shared_cex_log_args(cex_log)
+
   q = queue.Queue()
   threads = [ ]
   output_files = {}
@@ -530,6 +560,8 @@ def do_finisher(iterkey, logfile, nthreads, json_filename, main_args, args, invf
             stats.add_finisher_result(output_files[key], time.time() - t1)
             kill_all_procs()
 
+  remove_shared_cex_log(threads, cex_log)
+
   some_key = None
   for some_key in output_files:
     break
@@ -537,6 +569,7 @@ def do_finisher(iterkey, logfile, nthreads, json_filename, main_args, args, invf
     stats.add_finisher_result(output_files[some_key], time.time() - t1)
 
 chunkify_only = False
+share_cexes = False
 
 def parse_args(ivy_filename, args):
   nthreads = None
@@ -570,6 +603,9 @@ def parse_args(ivy_filename, args):
     elif args[i] == "--chunkify-only":
       global chunkify_only
       chunkify_only = True
+    elif args[i] == "--share-cexes":
+      global share_cexes
+      share_cexes = True
     else:
       new_args.append(args[i])
     i += 1
@@ -1,6 +1,7 @@
 #include "alt_depth2_synth_enumerator.h"
 
 #include "enumerator.h"
+#include "template_priority.h"
 #include "var_lex_graph.h"
 #include "utils.h"
 
@@ -17,6 +18,7 @@ AltDepth2CandidateSolver::AltDepth2CandidateSolver(
   , start_from(-1)
   , done_cutoff(0)
   , finish_at_cutoff(false)
+  , recheck_last(false)
 {
   cout << "Using AltDepth2CandidateSolver" << endl;
   cout << "total_arity: " << total_arity << endl;
@@ -58,6 +60,7 @@ void AltDepth2CandidateSolver::addCounterexample(Counterexample cex)
   assert (cex.is_true || cex.is_false || (cex.hypothesis && cex.conclusion));
 
   cexes.push_back(cex);
+  cex_order.add();
   int i = cexes.size() - 1;
 
   AlternationBitsetEvaluator abe1;
@@ -83,19 +86,15 @@ void AltDepth2CandidateSolver::addCounterexample(Counterexample cex)
   abes.push_back(make_pair(move(abe1), move(abe2)));
 
   cex_results.push_back({});
-  cex_results[i].resize(pieces.size());
-
-  for (int j = 0; j < (int)pieces.size(); j++) {
-    if (cex.is_true) {
-      cex_results[i][j].second = BitsetEvalResult::eval_over_alternating_quantifiers(cex.is_true, pieces[j]);
-    }
-    else if (cex.is_false) {
-      cex_results[i][j].first = BitsetEvalResult::eval_over_alternating_quantifiers(cex.is_false, pieces[j]);
-    }
-    else {
-      cex_results[i][j].first = BitsetEvalResult::eval_over_alternating_quantifiers(cex.hypothesis, pieces[j]);
-      cex_results[i][j].second = BitsetEvalResult::eval_over_alternating_quantifiers(cex.conclusion, pieces[j]);
-    }
+  if (cex.is_true) {
+    cex_results[i].second = BitsetEvalMatrix::eval_over_alternating_quantifiers(cex.is_true, pieces);
+  }
+  else if (cex.is_false) {
+    cex_results[i].first = BitsetEvalMatrix::eval_over_alternating_quantifiers(cex.is_false, pieces);
+  }
+  else {
+    cex_results[i].first = BitsetEvalMatrix::eval_over_alternating_quantifiers(cex.hypothesis, pieces);
+    cex_results[i].second = BitsetEvalMatrix::eval_over_alternating_quantifiers(cex.conclusion, pieces);
   }
 }
 
@@ -107,7 +106,7 @@ void AltDepth2CandidateSolver::addExistingInvariant(value inv0)
     existing_invariants_append(indices);
 
     value norm = inv->totally_normalize();
-    existing_invariant_set.insert(ComparableValue(norm));
+    existing_invariant_set.insert(interner.intern(norm));
   }*/
 }
 
@@ -115,10 +114,10 @@ value AltDepth2CandidateSolver::get_clause(int i)
 {
   value v = pieces[i];
   while (true) {
-    if (Forall* f = dynamic_cast<Forall*>(v.get())) {
+    if (Forall* f = value_cast<Forall>(v.get())) {
       v = f->body;
     }
-    else if (Exists* f = dynamic_cast<Exists*>(v.get())) {
+    else if (Exists* f = value_cast<Exists>(v.get())) {
       v = f->body;
     }
     else {
@@ -154,7 +153,7 @@ value AltDepth2CandidateSolver::get_current_value()
 
 value AltDepth2CandidateSolver::getNext() {
   while (true) {
-    while (true) {
+    while (!recheck_last) {
       increment();
       if (done) {
         return nullptr;
@@ -165,7 +164,11 @@ value AltDepth2CandidateSolver::getNext() {
         break;
       }
     }
-    progress++;
+    if (recheck_last) {
+      recheck_last = false;
+    } else {
+      progress++;
+    }
 
     for (int i = 0; i < (int)cur_indices.size(); i++) {
       cur_indices[i] = slice_index_map[cur_indices_sub[i]];
@@ -187,9 +190,10 @@ value AltDepth2CandidateSolver::getNext() {
 
     //// Check if it violates a countereample
 
-    for (int i = 0; i < (int)cexes.size(); i++) {
+    for (int j = 0; j < cex_order.size(); j++) {
+      int i = cex_order[j];
       if (cexes[i].is_true) {
-        setup_abe2(abes[i].second, cex_results[i], cur_indices);
+        setup_abe2(abes[i].second, cex_results[i].second, cur_indices);
         bool res = abes[i].second.evaluate();
         //if (res != cexes[i].is_true->eval_predicate(sanity_v)) {
           /*cexes[i].is_true->dump();
@@ -202,28 +206,31 @@ value AltDepth2CandidateSolver::getNext() {
          // assert(false);
         //}
         if (!res) {
+          cex_order.record_kill(j);
           failed = true;
           break;
         }
       }
       else if (cexes[i].is_false) {
-        setup_abe1(abes[i].first, cex_results[i], cur_indices);
+        setup_abe1(abes[i].first, cex_results[i].first, cur_indices);
         bool res = abes[i].first.evaluate();
         //assert (res == cexes[i].is_false->eval_predicate(sanity_v));
         if (res) {
+          cex_order.record_kill(j);
           failed = true;
           break;
         }
       }
       else {
-        setup_abe1(abes[i].first, cex_results[i], cur_indices);
+        setup_abe1(abes[i].first, cex_results[i].first, cur_indices);
         bool res = abes[i].first.evaluate();
         //assert (res == cexes[i].hypothesis->eval_predicate(sanity_v));
         if (res) {
-          setup_abe2(abes[i].second, cex_results[i], cur_indices);
+          setup_abe2(abes[i].second, cex_results[i].second, cur_indices);
           bool res2 = abes[i].second.evaluate();
           //assert (res2 == cexes[i].conclusion->eval_predicate(sanity_v));
           if (!res2) {
+            cex_order.record_kill(j);
             failed = true;
             break;
           }
@@ -237,7 +244,7 @@ value AltDepth2CandidateSolver::getNext() {
 
     //// Check if it's equivalent to an existing invariant
     //// by some normalization.
-    /*if (existing_invariant_set.count(ComparableValue(v->totally_normalize())) > 0) {
+    /*if (existing_invariant_set.count(interner.find(v->totally_normalize())) > 0) {
       existing_invariants_append(make_pair(simple_indices, ci));
       continue;
     }*/
@@ -339,7 +346,7 @@ body_end:
 }
 
 void AltDepth2CandidateSolver::setup_abe1(AlternationBitsetEvaluator& abe, 
-    std::vector<std::pair<BitsetEvalResult, BitsetEvalResult>> const& cex_result,
+    BitsetEvalMatrix const& cex_result,
     std::vector<int> const& cur_indices)
 {
   TreeShape const& ts = tree_shapes[tree_shape_idx];
@@ -351,7 +358,7 @@ void AltDepth2CandidateSolver::setup_abe1(AlternationBitsetEvaluator& abe,
 
   int k = 0;
 
-  int sz = cex_result[cur_indices[k]].first.v.size();
+  int sz = cex_result.num_words;
   if ((int)evaluator_buf.size() < sz) {
     evaluator_buf.resize(sz);
   }
@@ -359,19 +366,19 @@ void AltDepth2CandidateSolver::setup_abe1(AlternationBitsetEvaluator& abe,
   for (int i = 0; i < (int)ts.parts.size(); i++) {
     if (ts.parts[i] == 1) {
       if (ts.top_level_is_conj) {
-        abe.add_conj(cex_result[cur_indices[k]].first);
+        abe.add_conj(sz, cex_result.row(cur_indices[k]));
       } else {
-        abe.add_disj(cex_result[cur_indices[k]].first);
+        abe.add_disj(sz, cex_result.row(cur_indices[k]));
       }
       k++;
     } else {
-      vec_copy_ber(evaluator_buf, cex_result[cur_indices[k]].first);
+      vec_copy_row(evaluator_buf, sz, cex_result.row(cur_indices[k]));
       k++;
       for (int j = 1; j < (int)ts.parts[i]; j++) {
         if (ts.top_level_is_conj) {
-          vec_apply_disj(evaluator_buf, cex_result[cur_indices[k]].first);
+          vec_apply_disj(evaluator_buf, sz, cex_result.row(cur_indices[k]));
         } else {
-          vec_apply_conj(evaluator_buf, cex_result[cur_indices[k]].first);
+          vec_apply_conj(evaluator_buf, sz, cex_result.row(cur_indices[k]));
         }
         k++;
       }
@@ -385,7 +392,7 @@ void AltDepth2CandidateSolver::setup_abe1(AlternationBitsetEvaluator& abe,
 }
 
 void AltDepth2CandidateSolver::setup_abe2(AlternationBitsetEvaluator& abe, 
-    std::vector<std::pair<BitsetEvalResult, BitsetEvalResult>> const& cex_result,
+    BitsetEvalMatrix const& cex_result,
     std::vector<int> const& cur_indices)
 {
   TreeShape const& ts = tree_shapes[tree_shape_idx];
@@ -397,7 +404,7 @@ void AltDepth2CandidateSolver::setup_abe2(AlternationBitsetEvaluator& abe,
 
   int k = 0;
 
-  int sz = cex_result[cur_indices[k]].second.v.size();
+  int sz = cex_result.num_words;
   if ((int)evaluator_buf.size() < sz) {
     evaluator_buf.resize(sz);
   }
@@ -405,19 +412,19 @@ void AltDepth2CandidateSolver::setup_abe2(AlternationBitsetEvaluator& abe,
   for (int i = 0; i < (int)ts.parts.size(); i++) {
     if (ts.parts[i] == 1) {
       if (ts.top_level_is_conj) {
-        abe.add_conj(cex_result[cur_indices[k]].second);
+        abe.add_conj(sz, cex_result.row(cur_indices[k]));
       } else {
-        abe.add_disj(cex_result[cur_indices[k]].second);
+        abe.add_disj(sz, cex_result.row(cur_indices[k]));
       }
       k++;
     } else {
-      vec_copy_ber(evaluator_buf, cex_result[cur_indices[k]].second);
+      vec_copy_row(evaluator_buf, sz, cex_result.row(cur_indices[k]));
       k++;
       for (int j = 1; j < (int)ts.parts[i]; j++) {
         if (ts.top_level_is_conj) {
-          vec_apply_disj(evaluator_buf, cex_result[cur_indices[k]].second);
+          vec_apply_disj(evaluator_buf, sz, cex_result.row(cur_indices[k]));
         } else {
-          vec_apply_conj(evaluator_buf, cex_result[cur_indices[k]].second);
+          vec_apply_conj(evaluator_buf, sz, cex_result.row(cur_indices[k]));
         }
         k++;
       }
@@ -459,6 +466,14 @@ void AltDepth2CandidateSolver::setSubSlice(TemplateSubSlice const& tss)
   done_cutoff = tss.prefix.size();
   done = false;
   finish_at_cutoff = true;
+  recheck_last = false;
+}
+
+vector<TemplateSubSlice> AltDepth2CandidateSolver::splitSubSlice(TemplateSubSlice const& tss)
+{
+  assert (0 <= tss.tree_idx && tss.tree_idx < (int)tree_shapes.size());
+  auto p = get_subslice_index_map(ts, tss.ts);
+  return split_sub_slice_by_prefix(p.first.second, tree_shapes[tss.tree_idx], tss);
 }
 
 long long AltDepth2CandidateSolver::getPreSymmCount() {
@@ -20,6 +20,7 @@ public:
   long long getProgress() { return progress; }
   long long getPreSymmCount();
   long long getSpaceSize() { assert(false); }
+  std::vector<long long> getCexKillCounts() { return cex_order.kills; }
 
 //private:
   std::shared_ptr<Module> module;
@@ -45,10 +46,12 @@ public:
   int done_cutoff;
   bool finish_at_cutoff;
   bool done;
+  bool recheck_last;
 
   std::vector<Counterexample> cexes;
-  std::vector<std::vector<std::pair<BitsetEvalResult, BitsetEvalResult>>> cex_results;
+  std::vector<std::pair<BitsetEvalMatrix, BitsetEvalMatrix>> cex_results;
   std::vector<std::pair<AlternationBitsetEvaluator, AlternationBitsetEvaluator>> abes;
+  CexOrder cex_order;
 
   TransitionSystem ts;
 
@@ -60,14 +63,16 @@ public:
   value get_clause(int);
 
   void setup_abe1(AlternationBitsetEvaluator& abe, 
-      std::vector<std::pair<BitsetEvalResult, BitsetEvalResult>> const& cex_result,
+      BitsetEvalMatrix const& cex_result,
       std::vector<int> const& cur_indices);
 
   void setup_abe2(AlternationBitsetEvaluator& abe, 
-      std::vector<std::pair<BitsetEvalResult, BitsetEvalResult>> const& cex_result,
+      BitsetEvalMatrix const& cex_result,
       std::vector<int> const& cur_indices);
 
   void setSubSlice(TemplateSubSlice const&);
+  std::vector<TemplateSubSlice> splitSubSlice(TemplateSubSlice const&);
+  void recheckLast() { recheck_last = true; }
 
   std::vector<uint64_t> evaluator_buf;
 };
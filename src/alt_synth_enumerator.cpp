@@ -3,11 +3,14 @@
 #include <algorithm>
 
 #include "enumerator.h"
+#include "template_priority.h"
 #include "var_lex_graph.h"
 #include "auto_redundancy_filters.h"
 
 using namespace std;
 
+bool bitset_subsumption_index = false;
+
 AltDisjunctCandidateSolver::AltDisjunctCandidateSolver(
       shared_ptr<Module> module,
       TemplateSpace const& tspace)
@@ -19,6 +22,16 @@ AltDisjunctCandidateSolver::AltDisjunctCandidateSolver(
   , start_from(-1)
   , done_cutoff(0)
   , finish_at_cutoff(false)
+  , recheck_last(false)
+  , next_stamp(0)
+  , defer_equivalent_invariants(false)
+  , stealable(false)
+  , top_index(-1)
+  , top_limit(0)
+  , batch_size(1)
+  , batch_pos(0)
+  , batch_num_cexes(0)
+  , batch_num_invs(0)
 {
   cout << "Using AltDisjunctCandidateSolver" << endl;
   cout << "disj_arity: " << disj_arity << endl;
@@ -43,12 +56,17 @@ AltDisjunctCandidateSolver::AltDisjunctCandidateSolver(
   done = false;
 
   var_index_states.resize(disj_arity + 2);
+  level_stamps.resize(disj_arity + 2);
 
   ts = build_transition_system(
       get_var_index_init_state(module, templ),
       ei.var_index_transitions, -1);
 
-  existing_invariant_trie = SubsequenceTrie(pieces.size());
+  if (bitset_subsumption_index) {
+    existing_invariant_bitsets = SubsetBitsetIndex(pieces.size());
+  } else {
+    existing_invariant_trie = SubsequenceTrie(pieces.size());
+  }
 
   cout << "ello" << endl;
   for (vector<int> const& indices : get_auto_redundancy_filters(pieces)) {
@@ -65,6 +83,7 @@ void AltDisjunctCandidateSolver::addCounterexample(Counterexample cex)
   assert (cex.is_true || cex.is_false || (cex.hypothesis && cex.conclusion));
 
   cexes.push_back(cex);
+  cex_order.add();
   int i = cexes.size() - 1;
 
   AlternationBitsetEvaluator abe1;
@@ -90,26 +109,238 @@ void AltDisjunctCandidateSolver::addCounterexample(Counterexample cex)
   abes.push_back(make_pair(move(abe1), move(abe2)));
 
   cex_results.push_back({});
-  cex_results[i].resize(pieces.size());
+  if (cex.is_true) {
+    cex_results[i].second = BitsetEvalMatrix::eval_over_alternating_quantifiers(cex.is_true, pieces);
+  }
+  else if (cex.is_false) {
+    cex_results[i].first = BitsetEvalMatrix::eval_over_alternating_quantifiers(cex.is_false, pieces);
+  }
+  else {
+    cex_results[i].first = BitsetEvalMatrix::eval_over_alternating_quantifiers(cex.hypothesis, pieces);
+    cex_results[i].second = BitsetEvalMatrix::eval_over_alternating_quantifiers(cex.conclusion, pieces);
+  }
+
+  conclusion_suffix_or.push_back({});
+  compute_conclusion_suffix_or(i);
+
+  cover_last.push_back({});
+  prefix_uncovered.push_back({});
+  init_coverage(i);
+
+  prefix_ors.push_back({});
+  prefix_stamps.push_back({});
+  init_prefix_ors(i);
+}
+
+void AltDisjunctCandidateSolver::compute_conclusion_suffix_or(int i)
+{
+  vector<BitsetEvalResult>& suffix_or = conclusion_suffix_or[i];
+  suffix_or.clear();
+  if (!cexes[i].hypothesis) {
+    return;
+  }
+
+  int n = slice_index_map.size();
+  suffix_or.resize(n + 1);
+  suffix_or[n] = cex_results[i].second.zero_row();
+  for (int p = n - 1; p >= 0; p--) {
+    suffix_or[p] = suffix_or[p+1];
+    suffix_or[p].apply_disj(cex_results[i].second.row(slice_index_map[p]));
+  }
+}
+
+// Lowest bit not set in ber, or -1 if all of them are
+static int lowest_unset_bit(BitsetEvalResult const& ber)
+{
+  int n = ber.v.size();
+  for (int w = 0; w < n; w++) {
+    uint64_t x = ~ber.v[w] & (w == n - 1 ? ber.last_bits : ~(uint64_t)0);
+    if (x != 0) {
+      return 64 * w + __builtin_ctzll(x);
+    }
+  }
+  return -1;
+}
 
+void AltDisjunctCandidateSolver::init_coverage(int i)
+{
+  // Only a single forall block evaluates to "all bits are set"
+  AlternationBitsetEvaluator const& abe = abes[i].second;
+  if (!cexes[i].is_true || !abe.levels.empty() || !abe.final_conj
+      || cex_results[i].second.num_words == 0) {
+    return;
+  }
+
+  BitsetEvalMatrix const& m = cex_results[i].second;
+  int nbits = 64 * (m.num_words - 1) + __builtin_popcountll(m.last_bits);
+  cover_last[i].assign(nbits, -1);
   for (int j = 0; j < (int)pieces.size(); j++) {
-    if (cex.is_true) {
-      cex_results[i][j].second = BitsetEvalResult::eval_over_alternating_quantifiers(cex.is_true, pieces[j]);
+    uint64_t const* v = m.row(j);
+    for (int w = 0; w < m.num_words; w++) {
+      for (uint64_t x = v[w]; x != 0; x &= x - 1) {
+        int b = 64 * w + __builtin_ctzll(x);
+        if (b < nbits) {
+          cover_last[i][b] = j;
+        }
+      }
     }
-    else if (cex.is_false) {
-      cex_results[i][j].first = BitsetEvalResult::eval_over_alternating_quantifiers(cex.is_false, pieces[j]);
+  }
+
+  prefix_uncovered[i].resize(disj_arity + 1);
+  prefix_uncovered[i][0] = nbits > 0 ? 0 : -1;
+  coverage_cexes.push_back(i);
+}
+
+void AltDisjunctCandidateSolver::init_prefix_ors(int i)
+{
+  vector<pair<BitsetEvalResult, BitsetEvalResult>>& ors = prefix_ors[i];
+  ors.resize(disj_arity + 1);
+  ors[0].first = cex_results[i].first.zero_row();
+  ors[0].second = cex_results[i].second.zero_row();
+  for (int d = 1; d < (int)ors.size(); d++) {
+    ors[d] = ors[0];
+  }
+
+  // level 0 is the empty prefix and never changes
+  prefix_stamps[i].resize(disj_arity + 1);
+  prefix_stamps[i][0] = level_stamps[0];
+  for (int d = 1; d < (int)prefix_stamps[i].size(); d++) {
+    prefix_stamps[i][d] = -1;
+  }
+}
+
+// Make prefix_ors[i][d] match cur_indices_sub[0 .. d-1]. Setting an index
+// always re-sets all the indices after it before the next leaf, so if
+// level e is current then so are the levels below it.
+void AltDisjunctCandidateSolver::update_prefix_ors(int i, int d)
+{
+  int e = d;
+  while (prefix_stamps[i][e] != level_stamps[e]) {
+    e--;
+  }
+  for (; e < d; e++) {
+    int q = slice_index_map[cur_indices_sub[e]];
+    auto const& cur = prefix_ors[i][e];
+    auto& next = prefix_ors[i][e+1];
+    if (!cexes[i].is_false) {
+      vec_copy_ber(next.second.v, cur.second);
+      next.second.apply_disj(cex_results[i].second.row(q));
+      if (!cover_last[i].empty()) {
+        prefix_uncovered[i][e+1] = lowest_unset_bit(next.second);
+      }
     }
-    else {
-      cex_results[i][j].first = BitsetEvalResult::eval_over_alternating_quantifiers(cex.hypothesis, pieces[j]);
-      cex_results[i][j].second = BitsetEvalResult::eval_over_alternating_quantifiers(cex.conclusion, pieces[j]);
+    if (!cexes[i].is_true) {
+      vec_copy_ber(next.first.v, cur.first);
+      next.first.apply_disj(cex_results[i].first.row(q));
+    }
+    prefix_stamps[i][e+1] = level_stamps[e+1];
+  }
+}
+
+// Adding disjuncts can only make the candidate "more true". So if the
+// prefix cur_indices_sub[0 .. t] is already true on an is_false cex, or
+// on the hypothesis of a cex whose conclusion stays false no matter which
+// pieces are added, every candidate extending the prefix gets rejected.
+bool AltDisjunctCandidateSolver::prefix_is_doomed(int t)
+{
+  // Checking every cex against the prefix only pays off if the subtree
+  // has more leaves than that; getNext() usually rejects a leaf after
+  // trying just a few cexes.
+  int m = (int)slice_index_map.size() - 1 - cur_indices_sub[t];
+  int r = (int)cur_indices_sub.size() - 1 - t;
+  double num_leaves = 1;
+  for (int j = 0; j < r; j++) {
+    num_leaves = num_leaves * (m - j) / (j + 1);
+  }
+  if (num_leaves < (double)cexes.size()) {
+    return false;
+  }
+
+  for (int j = 0; j < cex_order.size(); j++) {
+    int i = cex_order[j];
+    if (cexes[i].is_true) {
+      continue;
+    }
+
+    update_prefix_ors(i, t+1);
+    abes[i].first.reset_for_disj(prefix_ors[i][t+1].first);
+    if (!abes[i].first.evaluate()) {
+      continue;
+    }
+
+    if (cexes[i].is_false) {
+      cex_order.move_to_front(j);
+      numDoomedPrefixes++;
+      return true;
+    }
+
+    abes[i].second.reset_for_disj(prefix_ors[i][t+1].second);
+    abes[i].second.add_disj(conclusion_suffix_or[i][cur_indices_sub[t] + 1]);
+    if (!abes[i].second.evaluate()) {
+      cex_order.move_to_front(j);
+      numDoomedPrefixes++;
+      return true;
     }
   }
+  return false;
+}
+
+// Returns the first slice position from cur_indices_sub[t] on (or n if there
+// is none) that can still lead to a candidate covering every bit of the
+// coverage cexes. If no piece at or after the current position sets the
+// lowest bit the prefix leaves uncovered, nothing at this level can. At the
+// last level, the piece itself has to set that bit.
+int AltDisjunctCandidateSolver::coverage_next(int t)
+{
+  int n = slice_index_map.size();
+  bool last_level = (t + 1 == (int)cur_indices_sub.size());
+  for (int i : coverage_cexes) {
+    update_prefix_ors(i, t);
+  }
+
+  for (int p = cur_indices_sub[t]; p < n; p++) {
+    int q = slice_index_map[p];
+    bool covers = true;
+    for (int i : coverage_cexes) {
+      int b = prefix_uncovered[i][t];
+      if (b == -1) {
+        continue;
+      }
+      if (cover_last[i][b] < q) {
+        return n;
+      }
+      if (last_level && !cex_results[i].second.get_bit(q, b)) {
+        covers = false;
+        break;
+      }
+    }
+    if (covers) {
+      return p;
+    }
+  }
+  return n;
 }
 
 void AltDisjunctCandidateSolver::existing_invariants_append(std::vector<int> const& indices)
 {
   existing_invariant_indices.push_back(indices);
-  existing_invariant_trie.insert(indices);
+  if (bitset_subsumption_index) {
+    existing_invariant_bitsets.insert(indices);
+  } else {
+    existing_invariant_trie.insert(indices);
+  }
+}
+
+// Whether `indices` contains some existing invariant's index-sequence; if so,
+// upTo is the length of a prefix of `indices` that does.
+bool AltDisjunctCandidateSolver::contains_existing_invariant(
+    vector<int> const& indices, int& upTo)
+{
+  if (bitset_subsumption_index) {
+    return existing_invariant_bitsets.query(indices, upTo);
+  } else {
+    return existing_invariant_trie.query(indices, upTo);
+  }
 }
 
 void AltDisjunctCandidateSolver::addExistingInvariant(value inv0)
@@ -120,7 +351,9 @@ void AltDisjunctCandidateSolver::addExistingInvariant(value inv0)
     existing_invariants_append(indices);
 
     value norm = inv->totally_normalize();
-    existing_invariant_set.insert(ComparableValue(norm));
+    existing_invariant_set.insert(value_fingerprint(norm),
+        existing_invariant_norms.size());
+    existing_invariant_norms.push_back(norm);
   }
 }
 
@@ -150,39 +383,39 @@ void AltDisjunctCandidateSolver::init_piece_to_index() {
   for (int i = 0; i < (int)pieces.size(); i++) {
     value v = pieces[i];
     while (true) {
-      if (Forall* f = dynamic_cast<Forall*>(v.get())) {
+      if (Forall* f = value_cast<Forall>(v.get())) {
         v = f->body;
       }
-      else if (Exists* f = dynamic_cast<Exists*>(v.get())) {
+      else if (Exists* f = value_cast<Exists>(v.get())) {
         v = f->body;
       }
       else {
         break;
       }
     }
-    piece_to_index.insert(make_pair(ComparableValue(v), i));
+    piece_to_index.insert(make_pair(interner.intern(v), i));
   }
 }
 
 int AltDisjunctCandidateSolver::get_index_of_piece(value p) {
-  auto it = piece_to_index.find(ComparableValue(p));
+  auto it = piece_to_index.find(interner.find(p));
   assert (it != piece_to_index.end());
   return it->second;
 }
 
 vector<int> AltDisjunctCandidateSolver::get_indices_of_value(value inv) {
   while (true) {
-    if (Forall* f = dynamic_cast<Forall*>(inv.get())) {
+    if (Forall* f = value_cast<Forall>(inv.get())) {
       inv = f->body;
     }
-    else if (Exists* f = dynamic_cast<Exists*>(inv.get())) {
+    else if (Exists* f = value_cast<Exists>(inv.get())) {
       inv = f->body;
     }
     else {
       break;
     }
   }
-  Or* o = dynamic_cast<Or*>(inv.get());
+  Or* o = value_cast<Or>(inv.get());
   if (o != NULL) {
     vector<int> t;
     t.resize(o->args.size());
@@ -201,10 +434,10 @@ vector<int> AltDisjunctCandidateSolver::get_indices_of_value(value inv) {
 value AltDisjunctCandidateSolver::disjunction_fuse(vector<value> values) {
   for (int i = 0; i < (int)values.size(); i++) {
     while (true) {
-      if (Forall* f = dynamic_cast<Forall*>(values[i].get())) {
+      if (Forall* f = value_cast<Forall>(values[i].get())) {
         values[i] = f->body;
       }
-      else if (Exists* f = dynamic_cast<Exists*>(values[i].get())) {
+      else if (Exists* f = value_cast<Exists>(values[i].get())) {
         values[i] = f->body;
       }
       else {
@@ -217,8 +450,12 @@ value AltDisjunctCandidateSolver::disjunction_fuse(vector<value> values) {
 }
 
 value AltDisjunctCandidateSolver::getNext() {
+  if (batch_size > 1) {
+    return getNextBatched();
+  }
+
   while (true) {
-    while (true) {
+    while (!recheck_last) {
       //cout << "start increment" << endl;
       increment();
       //cout << "hi" << endl;
@@ -235,7 +472,11 @@ value AltDisjunctCandidateSolver::getNext() {
       }
       //cout << "bro" << endl;
     }
-    progress++;
+    if (recheck_last) {
+      recheck_last = false;
+    } else {
+      progress++;
+    }
     //cout << "attempting" << endl;
 
     for (int i = 0; i < (int)cur_indices.size(); i++) {
@@ -258,7 +499,7 @@ value AltDisjunctCandidateSolver::getNext() {
     //// Check if it contains an existing invariant
 
     int upTo;
-    if (existing_invariant_trie.query(cur_indices, upTo /* output */)) {
+    if (contains_existing_invariant(cur_indices, upTo /* output */)) {
       numEnumeratedFilteredRedundantInvariants++;
       this->skipAhead(upTo);
       failed = true;
@@ -268,46 +509,47 @@ value AltDisjunctCandidateSolver::getNext() {
 
     //// Check if it violates a countereample
 
-    for (int i = 0; i < (int)cexes.size(); i++) {
+    // Everything but the last piece is already OR'ed together in prefix_ors
+    int last = cur_indices.size() - 1;
+    for (int j = 0; j < cex_order.size(); j++) {
+      int i = cex_order[j];
+      update_prefix_ors(i, last);
+      auto const& r = cex_results[i];
+      int q = cur_indices[last];
       if (cexes[i].is_true) {
-        abes[i].second.reset_for_disj();
-        for (int j = 0; j < (int)cur_indices.size(); j++) {
-          abes[i].second.add_disj(cex_results[i][cur_indices[j]].second);
-        }
+        abes[i].second.reset_for_disj(prefix_ors[i][last].second);
+        abes[i].second.add_disj(r.second.num_words, r.second.row(q));
         bool res = abes[i].second.evaluate();
         //assert (res == cexes[i].is_true->eval_predicate(sanity_v));
         if (!res) {
+          cex_order.record_kill(j);
           failed = true;
           break;
         }
       }
       else if (cexes[i].is_false) {
-        abes[i].first.reset_for_disj();
-        for (int j = 0; j < (int)cur_indices.size(); j++) {
-          abes[i].first.add_disj(cex_results[i][cur_indices[j]].first);
-        }
+        abes[i].first.reset_for_disj(prefix_ors[i][last].first);
+        abes[i].first.add_disj(r.first.num_words, r.first.row(q));
         bool res = abes[i].first.evaluate();
         //assert (res == cexes[i].is_false->eval_predicate(sanity_v));
         if (res) {
+          cex_order.record_kill(j);
           failed = true;
           break;
         }
       }
       else {
-        abes[i].first.reset_for_disj();
-        for (int j = 0; j < (int)cur_indices.size(); j++) {
-          abes[i].first.add_disj(cex_results[i][cur_indices[j]].first);
-        }
+        abes[i].first.reset_for_disj(prefix_ors[i][last].first);
+        abes[i].first.add_disj(r.first.num_words, r.first.row(q));
         bool res = abes[i].first.evaluate();
         //assert (res == cexes[i].hypothesis->eval_predicate(sanity_v));
         if (res) {
-          abes[i].second.reset_for_disj();
-          for (int j = 0; j < (int)cur_indices.size(); j++) {
-            abes[i].second.add_disj(cex_results[i][cur_indices[j]].second);
-          }
+          abes[i].second.reset_for_disj(prefix_ors[i][last].second);
+          abes[i].second.add_disj(r.second.num_words, r.second.row(q));
           bool res2 = abes[i].second.evaluate();
           //assert (res2 == cexes[i].conclusion->eval_predicate(sanity_v));
           if (!res2) {
+            cex_order.record_kill(j);
             failed = true;
             break;
           }
@@ -317,29 +559,180 @@ value AltDisjunctCandidateSolver::getNext() {
 
     if (failed) continue;
 
-    //// Check if it's equivalent to an existing invariant
-    //// by some normalization.
+    value v = value_unless_equivalent(cur_indices);
+    if (v == nullptr) continue;
+
+    dump_indices(cur_indices_sub);
+    return v;
+  }
+}
+
+//// Check if it's equivalent to an existing invariant
+//// by some normalization. Returns nullptr if so (see
+//// defer_equivalent_invariants for the exception).
+value AltDisjunctCandidateSolver::value_unless_equivalent(vector<int> const& indices)
+{
+  // The fused and normalized formulas are temporaries; only a returned
+  // candidate is copied out of the arena.
+  ValueArena::Scope scope(arena);
+
+  last_equivalent.clear();
+
+  vector<value> disjs;
+  for (int i = 0; i < (int)indices.size(); i++) {
+    disjs.push_back(pieces[indices[i]]);
+  }
+  value v = disjunction_fuse(disjs);
+
+  value norm = v->totally_normalize();
+  if (existing_invariant_set.find_if(value_fingerprint(norm), [&](int id) {
+        return values_equal(existing_invariant_norms[id], norm);
+      })) {
+    if (defer_equivalent_invariants) {
+      last_equivalent = indices;
+      return arena.promote(v);
+    }
+    existing_invariants_append(indices);
+    return nullptr;
+  }
+  return arena.promote(v);
+}
+
+bool AltDisjunctCandidateSolver::passes_cex(int i, vector<int> const& indices)
+{
+  BitsetEvalMatrix const& first = cex_results[i].first;
+  BitsetEvalMatrix const& second = cex_results[i].second;
+  if (!cexes[i].is_true) {
+    abes[i].first.reset_for_disj();
+    for (int q : indices) {
+      abes[i].first.add_disj(first.num_words, first.row(q));
+    }
+    bool res = abes[i].first.evaluate();
+    if (cexes[i].is_false || !res) {
+      return !res;
+    }
+  }
+  abes[i].second.reset_for_disj();
+  for (int q : indices) {
+    abes[i].second.add_disj(second.num_words, second.row(q));
+  }
+  return abes[i].second.evaluate();
+}
+
+// Batched version of getNext(). Up to batch_size candidates that pass the
+// trie are collected first and then filtered one cex at a time, so that
+// each cex's rows stay in cache across the whole batch. Survivors are
+// handed out one per call; since cexes and invariants may have been added
+// in the meantime, each one is brought up to date before it is returned.
+value AltDisjunctCandidateSolver::getNextBatched()
+{
+  if (recheck_last) {
+    recheck_last = false;
+    assert (batch_pos > 0);
+    batch_pos--;
+  }
+
+  while (true) {
+    while (batch_pos < (int)batch.size()) {
+      BatchEntry const& entry = batch[batch_pos++];
+      if (!entry.alive) {
+        continue;
+      }
+
+      int upTo;
+      if ((int)existing_invariant_indices.size() != batch_num_invs
+          && contains_existing_invariant(entry.indices, upTo /* output */)) {
+        numEnumeratedFilteredRedundantInvariants++;
+        continue;
+      }
+
+      bool failed = false;
+      for (int i = batch_num_cexes; i < (int)cexes.size(); i++) {
+        if (!passes_cex(i, entry.indices)) {
+          failed = true;
+          break;
+        }
+      }
+      if (failed) continue;
+
+      value v = value_unless_equivalent(entry.indices);
+      if (v == nullptr) continue;
+
+      dump_indices(entry.indices_sub);
+      return v;
+    }
+
+    fill_batch();
+    if (batch.size() == 0) {
+      return nullptr;
+    }
+  }
+}
+
+void AltDisjunctCandidateSolver::fill_batch()
+{
+  batch.clear();
+  batch_pos = 0;
+  batch_num_cexes = cexes.size();
+
+  while (!done && (int)batch.size() < batch_size) {
+    increment();
+    if (done) {
+      break;
+    }
+    if (sub_ts.next(
+        var_index_states[cur_indices_sub.size()-1],
+        cur_indices_sub[cur_indices_sub.size()-1]) != target_state) {
+      continue;
+    }
+    progress++;
 
-    vector<value> disjs;
     for (int i = 0; i < (int)cur_indices.size(); i++) {
-      disjs.push_back(pieces[cur_indices[i]]);
+      cur_indices[i] = slice_index_map[cur_indices_sub[i]];
     }
-    value v = disjunction_fuse(disjs);
 
-    if (existing_invariant_set.count(ComparableValue(v->totally_normalize())) > 0) {
-      existing_invariants_append(cur_indices);
+    int upTo;
+    if (contains_existing_invariant(cur_indices, upTo /* output */)) {
+      numEnumeratedFilteredRedundantInvariants++;
+      this->skipAhead(upTo);
       continue;
     }
 
-    dump_cur_indices();
-    return v;
+    BatchEntry entry;
+    entry.indices_sub = cur_indices_sub;
+    entry.indices = cur_indices;
+    entry.alive = true;
+    batch.push_back(entry);
+  }
+  batch_num_invs = existing_invariant_indices.size();
+
+  int num_alive = batch.size();
+  for (int j = 0; j < cex_order.size() && num_alive > 0; j++) {
+    int i = cex_order[j];
+    int kills = 0;
+    for (BatchEntry& entry : batch) {
+      if (entry.alive && !passes_cex(i, entry.indices)) {
+        entry.alive = false;
+        kills++;
+      }
+    }
+    if (kills > 0) {
+      cex_order.record_kill(j, kills);
+      num_alive -= kills;
+    }
+  }
+
+  if (batch.size() > 0) {
+    numCandidateBatches++;
+    numBatchedCandidates += batch.size();
+    numBatchSurvivors += num_alive;
   }
 }
 
-void AltDisjunctCandidateSolver::dump_cur_indices()
+void AltDisjunctCandidateSolver::dump_indices(vector<int> const& indices_sub)
 {
   cout << "cur_indices_sub:";
-  for (int i : cur_indices_sub) {
+  for (int i : indices_sub) {
     cout << " " << i;
   }
   cout << " / " << slice_index_map.size() << endl;
@@ -350,7 +743,7 @@ void AltDisjunctCandidateSolver::dump_cur_indices()
 void AltDisjunctCandidateSolver::skipAhead(int upTo)
 {
   for (int i = upTo; i < (int)cur_indices_sub.size(); i++) {
-    cur_indices_sub[i] = (int)pieces.size() + i - (int)cur_indices_sub.size();
+    set_cur_index(i, (int)pieces.size() + i - (int)cur_indices_sub.size());
   }
 }
 
@@ -392,7 +785,7 @@ body_start:
       cur_indices_sub[t-1]);
   }
 
-  cur_indices_sub[t] = (t == 0 ? 0 : cur_indices_sub[t-1] + 1);
+  set_cur_index(t, t == 0 ? 0 : cur_indices_sub[t-1] + 1);
 
   goto loop_start_before_check;
 
@@ -404,14 +797,29 @@ loop_start:
   //cout << cur_indices_sub[t] << endl;
   //cout << sub_ts.nTransitions() << endl;
   //cout << slice_index_map.size() << endl;
+  if (!coverage_cexes.empty()) {
+    int p = coverage_next(t);
+    if (p != cur_indices_sub[t]) {
+      set_cur_index(t, p);
+      goto loop_start_before_check;
+    }
+  }
   if (sub_ts.next(var_index_states[t], cur_indices_sub[t]) != -1) {
+    // Leaves are checked by getNext(); for inner nodes, skip the whole
+    // subtree if no extension can survive the counterexamples.
+    if (t + 1 < (int)cur_indices_sub.size() && prefix_is_doomed(t)) {
+      goto call_end;
+    }
     t++;
     goto body_start;
   }
 
 call_end:
-  cur_indices_sub[t]++;
+  set_cur_index(t, cur_indices_sub[t] + 1);
 loop_start_before_check:
+  if (stealable && t == done_cutoff && !advance_top_index(cur_indices_sub[t])) {
+    goto body_end;
+  }
   if (cur_indices_sub[t] >= n) {
     goto body_end;
   }
@@ -443,13 +851,17 @@ void AltDisjunctCandidateSolver::setSubSlice(TemplateSubSlice const& tss)
   target_state = p.second;
   assert (target_state != -1);
 
+  for (int i = 0; i < (int)cexes.size(); i++) {
+    compute_conclusion_suffix_or(i);
+  }
+
   //cout << "chunk: " << sc.nums.size() << " / " << sc.size << endl;
   assert (tss.ts.k > 0);
   cur_indices_sub.resize(tss.ts.k);
   cur_indices.resize(tss.ts.k);
   assert ((int)tss.prefix.size() <= tss.ts.k);
   for (int i = 0; i < (int)tss.prefix.size(); i++) {
-    cur_indices_sub[i] = tss.prefix[i];
+    set_cur_index(i, tss.prefix[i]);
   }
   for (int i = 1; i <= (int)tss.prefix.size(); i++) {
     var_index_states[i] = sub_ts.next(
@@ -460,6 +872,52 @@ void AltDisjunctCandidateSolver::setSubSlice(TemplateSubSlice const& tss)
   done_cutoff = tss.prefix.size();
   done = false;
   finish_at_cutoff = true;
+  recheck_last = false;
+  batch.clear();
+  batch_pos = 0;
+
+  if (stealable) {
+    lock_guard<mutex> lock(top_mutex);
+    top_index = -1;
+    top_limit = slice_index_map.size();
+  }
+}
+
+// Returns false if the enumeration of the sub-slice should stop at `idx`
+bool AltDisjunctCandidateSolver::advance_top_index(int idx)
+{
+  lock_guard<mutex> lock(top_mutex);
+  top_index = idx;
+  return idx < top_limit;
+}
+
+void AltDisjunctCandidateSolver::getTopRange(int& top, int& limit)
+{
+  lock_guard<mutex> lock(top_mutex);
+  top = top_index;
+  limit = top_limit;
+}
+
+bool AltDisjunctCandidateSolver::stopTopIndexAt(int limit)
+{
+  assert (stealable);
+  lock_guard<mutex> lock(top_mutex);
+  if (limit <= top_index || limit >= top_limit) {
+    return false;
+  }
+  top_limit = limit;
+  return true;
+}
+
+vector<TemplateSubSlice> AltDisjunctCandidateSolver::splitSubSlice(TemplateSubSlice const& tss)
+{
+  auto p = get_subslice_index_map(ts, tss.ts);
+  vector<int> parts;
+  parts.resize(tss.ts.k);
+  for (int i = 0; i < tss.ts.k; i++) {
+    parts[i] = 1;
+  }
+  return split_sub_slice_by_prefix(p.first.second, tree_shape_for(true, parts), tss);
 }
 
 long long AltDisjunctCandidateSolver::getPreSymmCount() {
@@ -7,6 +7,8 @@
 #include "subsequence_trie.h"
 #include "template_desc.h"
 
+#include <mutex>
+
 class AltDisjunctCandidateSolver : public CandidateSolver {
 public:
   AltDisjunctCandidateSolver(
@@ -20,6 +22,7 @@ public:
   long long getProgress() { return progress; }
   long long getPreSymmCount();
   long long getSpaceSize() { assert(false); }
+  std::vector<long long> getCexKillCounts() { return cex_order.kills; }
   long long progress;
 
 //private:
@@ -43,30 +46,123 @@ public:
   int done_cutoff;
   bool finish_at_cutoff;
   bool done;
+  bool recheck_last;
 
   std::vector<Counterexample> cexes;
-  std::vector<std::vector<std::pair<BitsetEvalResult, BitsetEvalResult>>> cex_results;
+  std::vector<std::pair<BitsetEvalMatrix, BitsetEvalMatrix>> cex_results;
   std::vector<std::pair<AlternationBitsetEvaluator, AlternationBitsetEvaluator>> abes;
+  CexOrder cex_order;
+
+  // For each hypothesis/conclusion cex, conclusion_suffix_or[i][p] is the
+  // OR of the conclusion bitsets of the pieces at slice positions >= p.
+  std::vector<std::vector<BitsetEvalResult>> conclusion_suffix_or;
+
+  // prefix_ors[i][d] is the OR of cex_results[i][...] over the pieces at
+  // cur_indices_sub[0 .. d-1], so a leaf only needs to OR in its last piece.
+  // They are filled in lazily: level_stamps[d] changes whenever
+  // cur_indices_sub[d-1] is set, and prefix_stamps[i][d] is the
+  // level_stamps[d] that prefix_ors[i][d] was computed for.
+  std::vector<std::vector<std::pair<BitsetEvalResult, BitsetEvalResult>>> prefix_ors;
+  std::vector<std::vector<long long>> prefix_stamps;
+  std::vector<long long> level_stamps;
+  long long next_stamp;
+
+  // A pure-forall is_true cex only accepts candidates that cover every
+  // assignment. For those cexes, cover_last[i][b] is the largest piece index
+  // that sets bit b (-1 if there is none) and prefix_uncovered[i][d] is the
+  // lowest bit not set in prefix_ors[i][d] (-1 if they all are). Both are
+  // empty for the other cexes.
+  std::vector<int> coverage_cexes;
+  std::vector<std::vector<int>> cover_last;
+  std::vector<std::vector<int>> prefix_uncovered;
 
   std::vector<std::vector<int>> existing_invariant_indices;
   SubsequenceTrie existing_invariant_trie;
-
-  std::set<ComparableValue> existing_invariant_set;
-
-  std::map<ComparableValue, int> piece_to_index;
+  // Used instead of the trie with --bitset-subsumption-index
+  SubsetBitsetIndex existing_invariant_bitsets;
+
+  ValueInterner interner;
+
+  // Normalized existing invariants, indexed by fingerprint
+  std::vector<value> existing_invariant_norms;
+  FingerprintSet existing_invariant_set;
+
+  // Holds the formulas built for each candidate by value_unless_equivalent
+  ValueArena arena;
+
+  // Normally a candidate found equivalent to an existing invariant has its
+  // index-sequence added to the trie and is skipped. Whether that happens
+  // depends on which counterexamples are known at the time, so a worker
+  // thread enumerating ahead defers it: the candidate is returned with its
+  // index-sequence in last_equivalent (which is otherwise empty), and the
+  // consumer decides whether to add it (see ParallelOverlordCandidateSolver).
+  bool defer_equivalent_invariants;
+  std::vector<int> last_equivalent;
+
+  // With `stealable`, another thread can cut the current sub-slice short
+  // while getNext() runs (see stopTopIndexAt). top_index is the index being
+  // enumerated at level done_cutoff, and the enumeration stops once it
+  // reaches top_limit. Both are guarded by top_mutex.
+  bool stealable;
+  std::mutex top_mutex;
+  int top_index;
+  int top_limit;
+
+  // If more than 1, getNext() filters candidates in batches of this size
+  // (see getNextBatched).
+  int batch_size;
+  struct BatchEntry {
+    std::vector<int> indices_sub;
+    std::vector<int> indices;
+    bool alive;
+  };
+  std::vector<BatchEntry> batch;
+  int batch_pos;
+  // number of cexes / invariant index-sequences the batch was filtered with
+  int batch_num_cexes;
+  int batch_num_invs;
+
+  // interner id of each piece's body -> piece index
+  std::unordered_map<int, int> piece_to_index;
 
   TransitionSystem ts;
 
   void increment();
   void skipAhead(int upTo);
-  void dump_cur_indices();
+  void init_prefix_ors(int i);
+  void update_prefix_ors(int i, int d);
+  void set_cur_index(int t, int idx) {
+    cur_indices_sub[t] = idx;
+    level_stamps[t+1] = ++next_stamp;
+  }
+  bool prefix_is_doomed(int t);
+  bool advance_top_index(int idx);
+  void init_coverage(int i);
+  int coverage_next(int t);
+  void compute_conclusion_suffix_or(int i);
+  void dump_indices(std::vector<int> const& indices_sub);
+  value value_unless_equivalent(std::vector<int> const& indices);
+  bool passes_cex(int i, std::vector<int> const& indices);
+  value getNextBatched();
+  void fill_batch();
   value disjunction_fuse(std::vector<value> values);
   std::vector<int> get_indices_of_value(value inv);
   int get_index_of_piece(value p);
   void init_piece_to_index();
   void existing_invariants_append(std::vector<int> const& indices);
+  bool contains_existing_invariant(std::vector<int> const& indices, int& upTo);
 
   void setSubSlice(TemplateSubSlice const&);
+  std::vector<TemplateSubSlice> splitSubSlice(TemplateSubSlice const&);
+  void recheckLast() { recheck_last = true; }
+
+  // The range (top, limit) of indices at level done_cutoff that the current
+  // sub-slice has not got to yet
+  void getTopRange(int& top, int& limit);
+  // Makes the current sub-slice stop before index `limit` at level
+  // done_cutoff. Returns false, changing nothing, if the enumeration is
+  // already there. Only with `stealable`.
+  bool stopTopIndexAt(int limit);
 };
 
 #endif
@@ -15,33 +15,33 @@ bool has_subclause(value v, value sub)
     return true;
   }
 
-  if (Forall* value = dynamic_cast<Forall*>(v.get())) {
+  if (Forall* value = value_cast<Forall>(v.get())) {
     return has_subclause(value->body, sub);
   }
-  else if (Exists* value = dynamic_cast<Exists*>(v.get())) {
+  else if (Exists* value = value_cast<Exists>(v.get())) {
     return has_subclause(value->body, sub);
   }
-  else if (NearlyForall* value = dynamic_cast<NearlyForall*>(v.get())) {
+  else if (NearlyForall* value = value_cast<NearlyForall>(v.get())) {
     return has_subclause(value->body, sub);
   }
-  else if (dynamic_cast<Var*>(v.get())) {
+  else if (value_cast<Var>(v.get())) {
     return false;
   }
-  else if (dynamic_cast<Const*>(v.get())) {
+  else if (value_cast<Const>(v.get())) {
     return false;
   }
-  else if (Eq* value = dynamic_cast<Eq*>(v.get())) {
+  else if (Eq* value = value_cast<Eq>(v.get())) {
     return has_subclause(value->left, sub)
         || has_subclause(value->right, sub);
   }
-  else if (Not* value = dynamic_cast<Not*>(v.get())) {
+  else if (Not* value = value_cast<Not>(v.get())) {
     return has_subclause(value->val, sub);
   }
-  else if (Implies* value = dynamic_cast<Implies*>(v.get())) {
+  else if (Implies* value = value_cast<Implies>(v.get())) {
     return has_subclause(value->left, sub)
         || has_subclause(value->right, sub);
   }
-  else if (Apply* value = dynamic_cast<Apply*>(v.get())) {
+  else if (Apply* value = value_cast<Apply>(v.get())) {
     if (has_subclause(value->func, sub)) {
       return true;
     }
@@ -52,7 +52,7 @@ bool has_subclause(value v, value sub)
     }
     return false;
   }
-  else if (And* value = dynamic_cast<And*>(v.get())) {
+  else if (And* value = value_cast<And>(v.get())) {
     for (shared_ptr<Value> arg : value->args) {
       if (has_subclause(arg, sub)) {
         return true;
@@ -60,7 +60,7 @@ bool has_subclause(value v, value sub)
     }
     return false;
   }
-  else if (Or* value = dynamic_cast<Or*>(v.get())) {
+  else if (Or* value = value_cast<Or>(v.get())) {
     for (shared_ptr<Value> arg : value->args) {
       if (has_subclause(arg, sub)) {
         return true;
@@ -68,7 +68,7 @@ bool has_subclause(value v, value sub)
     }
     return false;
   }
-  else if (IfThenElse* value = dynamic_cast<IfThenElse*>(v.get())) {
+  else if (IfThenElse* value = value_cast<IfThenElse>(v.get())) {
     return has_subclause(value->cond, sub)
         || has_subclause(value->then_value, sub)
         || has_subclause(value->else_value, sub);
@@ -80,8 +80,8 @@ bool has_subclause(value v, value sub)
 }
 
 value get_later_not_var(value a, value b) {
-  assert (!dynamic_cast<Var*>(a.get()));
-  assert (!dynamic_cast<Var*>(b.get()));
+  assert (!value_cast<Var>(a.get()));
+  assert (!value_cast<Var>(b.get()));
   return lt_value(a, b) ? b : a;
 }
 
@@ -105,13 +105,13 @@ std::vector<std::vector<int>> get_auto_redundancy_filters(
   vector<vector<int>> res;
 
   for (int i = 0; i < (int)pieces.size(); i++) {
-    if (Not* n = dynamic_cast<Not*>(pieces[i].get())) {
+    if (Not* n = value_cast<Not>(pieces[i].get())) {
       for (int j = 0; j < (int)pieces.size(); j++) {
         if (values_equal(n->val, pieces[j])) {
           res.push_back(sort2(i,j));
         }
       }
-      if (Eq* e = dynamic_cast<Eq*>(n->val.get())) {
+      if (Eq* e = value_cast<Eq>(n->val.get())) {
         // Note: these aren't tautological, but they are redundant,
         // since one expression can always be replaced with the other.
         value dis_allowed = get_later_not_var(e->left, e->right);
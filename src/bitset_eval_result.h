@@ -5,6 +5,14 @@
 #include <cstring>
 #include <cassert>
 
+#include "bitset_kernels.h"
+
+// If set, then for formulas with more than one quantifier alternation,
+// each block of assignments to the outermost alternation's variables is
+// padded to a multiple of 64 bits. This costs memory for small models but
+// lets the evaluator combine blocks word by word instead of shifting.
+extern bool pad_bitset_blocks;
+
 struct BitsetEvalResult {
   std::vector<uint64_t> v;
   uint64_t last_bits;
@@ -37,15 +45,15 @@ struct BitsetEvalResult {
   }
 
   void apply_disj(BitsetEvalResult const& ber) {
-    for (int i = 0; i < (int)v.size(); i++) {
-      v[i] |= ber.v[i];
-    }
+    bitset_or_words(v.data(), ber.v.data(), v.size());
   }
 
   void apply_conj(BitsetEvalResult const& ber) {
-    for (int i = 0; i < (int)v.size(); i++) {
-      v[i] &= ber.v[i];
-    }
+    bitset_and_words(v.data(), ber.v.data(), v.size());
+  }
+
+  void apply_disj(uint64_t const* row) {
+    bitset_or_words(v.data(), row, v.size());
   }
 
   void dump() {
@@ -60,6 +68,80 @@ struct BitsetEvalResult {
   }
 };
 
+// The BitsetEvalResults of every piece on one model, as a single matrix
+// with one row per piece. Rows are padded to a multiple of 64 bytes and
+// start on a 64-byte boundary, so the rows of a candidate can be OR'ed
+// together without chasing a pointer per piece.
+struct BitsetEvalMatrix {
+  int num_rows;
+  int num_words;
+  int stride;
+  uint64_t last_bits;
+
+  BitsetEvalMatrix() : num_rows(0), num_words(0), stride(0), last_bits(0) { }
+
+  BitsetEvalMatrix(BitsetEvalMatrix const& m) : BitsetEvalMatrix() {
+    *this = m;
+  }
+  BitsetEvalMatrix(BitsetEvalMatrix&&) = default;
+  BitsetEvalMatrix& operator=(BitsetEvalMatrix&&) = default;
+
+  BitsetEvalMatrix& operator=(BitsetEvalMatrix const& m) {
+    // The copied storage need not have the same alignment, so copy by row
+    resize(m.num_rows, m.num_words);
+    last_bits = m.last_bits;
+    if (stride > 0) {
+      memcpy(base(), m.base(), sizeof(uint64_t) * num_rows * stride);
+    }
+    return *this;
+  }
+
+  // Evaluates every piece on `model`, sharing atom bitsets between pieces
+  static BitsetEvalMatrix eval_over_alternating_quantifiers(
+      std::shared_ptr<Model> model, std::vector<value> const& pieces);
+
+  void resize(int rows, int words) {
+    num_rows = rows;
+    num_words = words;
+    stride = (words + 7) / 8 * 8;
+    storage.assign((size_t)rows * stride + 7, 0);
+  }
+
+  // All rows must have the same length
+  void set_row(int j, BitsetEvalResult const& ber) {
+    assert ((int)ber.v.size() == num_words);
+    last_bits = ber.last_bits;
+    if (num_words > 0) {
+      memcpy(row(j), &ber.v[0], sizeof(uint64_t) * num_words);
+    }
+  }
+
+  uint64_t* row(int j) { return base() + (size_t)j * stride; }
+  uint64_t const* row(int j) const { return base() + (size_t)j * stride; }
+
+  bool get_bit(int j, int b) const {
+    return (row(j)[b / 64] >> (b % 64)) & 1;
+  }
+
+  // All-zeroes bitset of the same shape as a row
+  BitsetEvalResult zero_row() const {
+    BitsetEvalResult ber;
+    ber.v.assign(num_words, 0);
+    ber.last_bits = last_bits;
+    return ber;
+  }
+
+private:
+  std::vector<uint64_t> storage;
+
+  uint64_t* base() {
+    return (uint64_t*)(((uintptr_t)storage.data() + 63) & ~(uintptr_t)63);
+  }
+  uint64_t const* base() const {
+    return (uint64_t const*)(((uintptr_t)storage.data() + 63) & ~(uintptr_t)63);
+  }
+};
+
 struct BitsetLevel {
   int block_size;
   int num_blocks;
@@ -70,10 +152,10 @@ struct AlternationBitsetEvaluator {
   std::vector<BitsetLevel> levels;
   std::vector<uint64_t> scratch;
 
-  bool final_conj;
-  int final_num_full_words_64;
-  uint64_t final_last_bits;
-  uint64_t last_bits;
+  bool final_conj = false;
+  int final_num_full_words_64 = 0;
+  uint64_t final_last_bits = 0;
+  uint64_t last_bits = 0;
 
   static AlternationBitsetEvaluator make_evaluator(
       std::shared_ptr<Model> model, value v);
@@ -97,33 +179,48 @@ struct AlternationBitsetEvaluator {
       scratch[i] = 0;
     }
   }
+  // Same as reset_for_disj() followed by add_disj(ber)
+  void reset_for_disj(BitsetEvalResult const& ber) {
+    int n = ber.v.size();
+    for (int i = 0; i < n; i++) {
+      scratch[i] = ber.v[i];
+    }
+    for (int i = n; i < (int)scratch.size(); i++) {
+      scratch[i] = 0;
+    }
+  }
 
   void add_conj(BitsetEvalResult const& ber) {
-    for (int i = 0; i < (int)ber.v.size(); i++) {
-      scratch[i] &= ber.v[i];
-    }
+    bitset_and_words(&scratch[0], ber.v.data(), ber.v.size());
   }
   void add_disj(BitsetEvalResult const& ber) {
-    for (int i = 0; i < (int)ber.v.size(); i++) {
-      scratch[i] |= ber.v[i];
-    }
+    bitset_or_words(&scratch[0], ber.v.data(), ber.v.size());
+  }
+
+  void add_disj(int sz, uint64_t const* row) {
+    bitset_or_words(&scratch[0], row, sz);
+  }
+  void add_conj(int sz, uint64_t const* row) {
+    bitset_and_words(&scratch[0], row, sz);
   }
 
   void add_conj(int sz, std::vector<uint64_t> const& v) {
-    for (int i = 0; i < sz; i++) {
-      scratch[i] &= v[i];
-    }
+    bitset_and_words(&scratch[0], v.data(), sz);
   }
   void add_disj(int sz, std::vector<uint64_t> const& v) {
-    for (int i = 0; i < sz; i++) {
-      scratch[i] |= v[i];
-    }
+    bitset_or_words(&scratch[0], v.data(), sz);
   }
 
   static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "this requires little endian");
 
   // scratch[0 .. len] := scratch[0 .. len] & scratch[start .. start + len]
   void block_conj(int start, int len) {
+    // With padded blocks (see pad_bitset_blocks) no shifting is needed
+    if (start % 64 == 0 && len % 64 == 0) {
+      bitset_and_words(&scratch[0], &scratch[start / 64], len / 64);
+      return;
+    }
+
     // word of 4 bytes at a time
     int t;
     for (t = 0; 32*t <= len - 32; t++) {
@@ -155,6 +252,11 @@ struct AlternationBitsetEvaluator {
 
   // scratch[0 .. len] := scratch[0 .. len] | scratch[start .. start + len]
   void block_disj(int start, int len) {
+    if (start % 64 == 0 && len % 64 == 0) {
+      bitset_or_words(&scratch[0], &scratch[start / 64], len / 64);
+      return;
+    }
+
     int t;
     for (t = 0; 32*t <= len - 32; t++) {
       int bit_idx = 32*t + start;
@@ -234,16 +336,26 @@ inline void vec_copy_ber(std::vector<uint64_t>& v, BitsetEvalResult const& ber)
 }
 
 inline void vec_apply_disj(std::vector<uint64_t>& v, BitsetEvalResult const& ber) {
-  for (int i = 0; i < (int)ber.v.size(); i++) {
-    v[i] |= ber.v[i];
-  }
+  bitset_or_words(v.data(), ber.v.data(), ber.v.size());
 }
 
 inline void vec_apply_conj(std::vector<uint64_t>& v, BitsetEvalResult const& ber) {
-  for (int i = 0; i < (int)ber.v.size(); i++) {
-    v[i] &= ber.v[i];
+  bitset_and_words(v.data(), ber.v.data(), ber.v.size());
+}
+
+inline void vec_copy_row(std::vector<uint64_t>& v, int sz, uint64_t const* row) {
+  for (int i = 0; i < sz; i++) {
+    v[i] = row[i];
   }
 }
 
+inline void vec_apply_disj(std::vector<uint64_t>& v, int sz, uint64_t const* row) {
+  bitset_or_words(v.data(), row, sz);
+}
+
+inline void vec_apply_conj(std::vector<uint64_t>& v, int sz, uint64_t const* row) {
+  bitset_and_words(v.data(), row, sz);
+}
+
 
 #endif
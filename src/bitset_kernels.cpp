@@ -0,0 +1,100 @@
+#include "bitset_kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+static void and_words_scalar(uint64_t* dst, uint64_t const* src, int n)
+{
+  for (int i = 0; i < n; i++) {
+    dst[i] &= src[i];
+  }
+}
+
+static void or_words_scalar(uint64_t* dst, uint64_t const* src, int n)
+{
+  for (int i = 0; i < n; i++) {
+    dst[i] |= src[i];
+  }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+__attribute__((target("avx2")))
+static void and_words_avx2(uint64_t* dst, uint64_t const* src, int n)
+{
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256i a = _mm256_loadu_si256((__m256i const*)(dst + i));
+    __m256i b = _mm256_loadu_si256((__m256i const*)(src + i));
+    _mm256_storeu_si256((__m256i*)(dst + i), _mm256_and_si256(a, b));
+  }
+  for (; i < n; i++) {
+    dst[i] &= src[i];
+  }
+}
+
+__attribute__((target("avx2")))
+static void or_words_avx2(uint64_t* dst, uint64_t const* src, int n)
+{
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256i a = _mm256_loadu_si256((__m256i const*)(dst + i));
+    __m256i b = _mm256_loadu_si256((__m256i const*)(src + i));
+    _mm256_storeu_si256((__m256i*)(dst + i), _mm256_or_si256(a, b));
+  }
+  for (; i < n; i++) {
+    dst[i] |= src[i];
+  }
+}
+
+__attribute__((target("avx512f")))
+static void and_words_avx512(uint64_t* dst, uint64_t const* src, int n)
+{
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m512i a = _mm512_loadu_si512((void const*)(dst + i));
+    __m512i b = _mm512_loadu_si512((void const*)(src + i));
+    _mm512_storeu_si512((void*)(dst + i), _mm512_and_si512(a, b));
+  }
+  for (; i < n; i++) {
+    dst[i] &= src[i];
+  }
+}
+
+__attribute__((target("avx512f")))
+static void or_words_avx512(uint64_t* dst, uint64_t const* src, int n)
+{
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m512i a = _mm512_loadu_si512((void const*)(dst + i));
+    __m512i b = _mm512_loadu_si512((void const*)(src + i));
+    _mm512_storeu_si512((void*)(dst + i), _mm512_or_si512(a, b));
+  }
+  for (; i < n; i++) {
+    dst[i] |= src[i];
+  }
+}
+
+static BitsetKernels choose_bitset_kernels()
+{
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    return BitsetKernels{ and_words_avx512, or_words_avx512, "avx512" };
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    return BitsetKernels{ and_words_avx2, or_words_avx2, "avx2" };
+  }
+  return BitsetKernels{ and_words_scalar, or_words_scalar, "scalar" };
+}
+
+#else
+
+static BitsetKernels choose_bitset_kernels()
+{
+  return BitsetKernels{ and_words_scalar, or_words_scalar, "scalar" };
+}
+
+#endif
+
+BitsetKernels const bitset_kernels = choose_bitset_kernels();
@@ -0,0 +1,43 @@
+#ifndef BITSET_KERNELS_H
+#define BITSET_KERNELS_H
+
+#include <cstdint>
+
+// Word-wise AND / OR of bitsets, used by the bitset evaluators in
+// bitset_eval_result.h. The implementation (scalar, AVX2 or AVX-512) is
+// picked once at startup based on what the CPU supports.
+//
+// dst and src must not overlap.
+
+struct BitsetKernels {
+  void (*and_words)(uint64_t* dst, uint64_t const* src, int n);
+  void (*or_words)(uint64_t* dst, uint64_t const* src, int n);
+  char const* name;
+};
+
+extern BitsetKernels const bitset_kernels;
+
+// Short bitsets are not worth the indirect call
+const int BITSET_KERNEL_MIN_WORDS = 8;
+
+inline void bitset_and_words(uint64_t* dst, uint64_t const* src, int n) {
+  if (n < BITSET_KERNEL_MIN_WORDS) {
+    for (int i = 0; i < n; i++) {
+      dst[i] &= src[i];
+    }
+  } else {
+    bitset_kernels.and_words(dst, src, n);
+  }
+}
+
+inline void bitset_or_words(uint64_t* dst, uint64_t const* src, int n) {
+  if (n < BITSET_KERNEL_MIN_WORDS) {
+    for (int i = 0; i < n; i++) {
+      dst[i] |= src[i];
+    }
+  } else {
+    bitset_kernels.or_words(dst, src, n);
+  }
+}
+
+#endif
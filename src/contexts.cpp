@@ -1,5 +1,6 @@
 #include "contexts.h"
 
+#include <atomic>
 #include <cstdlib>
 #include <iostream>
 #include <cassert>
@@ -11,7 +12,8 @@
 using namespace std;
 using smt::expr;
 
-int name_counter = 1;
+// atomic since SMT checks can run on several threads (see solve_in_order)
+atomic<int> name_counter(1);
 string name(iden basename) {
   return "x" + to_string(rand()) + "_" +
       iden_to_string(basename) + "__" + to_string(name_counter++);
@@ -121,7 +123,7 @@ smt::expr ModelEmbedding::value2expr(
     std::unordered_map<iden, smt::expr> const& vars)
 {
   assert(v.get() != NULL);
-  if (Forall* value = dynamic_cast<Forall*>(v.get())) {
+  if (Forall* value = value_cast<Forall>(v.get())) {
     if (value->decls.size() == 0) {
       return value2expr(value->body, consts, vars);
     }
@@ -134,7 +136,7 @@ smt::expr ModelEmbedding::value2expr(
     }
     return smt::forall(vec_vars, value2expr(value->body, consts, new_vars));
   }
-  else if (Exists* value = dynamic_cast<Exists*>(v.get())) {
+  else if (Exists* value = value_cast<Exists>(v.get())) {
     if (value->decls.size() == 0) {
       return value2expr(value->body, consts, vars);
     }
@@ -147,7 +149,7 @@ smt::expr ModelEmbedding::value2expr(
     }
     return smt::exists(vec_vars, value2expr(value->body, consts, new_vars));
   }
-  else if (NearlyForall* value = dynamic_cast<NearlyForall*>(v.get())) {
+  else if (NearlyForall* value = value_cast<NearlyForall>(v.get())) {
     smt::expr_vector vec_vars(ctx->ctx);
     smt::expr_vector all_eq(ctx->ctx);
     std::unordered_map<iden, smt::expr> new_vars1 = vars;
@@ -167,7 +169,7 @@ smt::expr ModelEmbedding::value2expr(
     vec_or.push_back(smt::mk_and(all_eq));
     return smt::forall(vec_vars, smt::mk_or(vec_or));
   }
-  else if (Var* value = dynamic_cast<Var*>(v.get())) {
+  else if (Var* value = value_cast<Var>(v.get())) {
     auto iter = vars.find(value->name);
     if (iter == vars.end()) {
       printf("couldn't find var: %s\n", iden_to_string(value->name).c_str());
@@ -175,7 +177,7 @@ smt::expr ModelEmbedding::value2expr(
     }
     return iter->second;
   }
-  else if (Const* value = dynamic_cast<Const*>(v.get())) {
+  else if (Const* value = value_cast<Const>(v.get())) {
     auto iter = consts.find(value->name);
     if (iter == consts.end()) {
       auto iter = mapping.find(value->name);
@@ -189,25 +191,25 @@ smt::expr ModelEmbedding::value2expr(
       return iter->second;
     }
   }
-  else if (Eq* value = dynamic_cast<Eq*>(v.get())) {
+  else if (Eq* value = value_cast<Eq>(v.get())) {
     return value2expr(value->left, consts, vars) == value2expr(value->right, consts, vars);
   }
-  else if (Not* value = dynamic_cast<Not*>(v.get())) {
+  else if (Not* value = value_cast<Not>(v.get())) {
     return !value2expr(value->val, consts, vars);
   }
-  else if (Implies* value = dynamic_cast<Implies*>(v.get())) {
+  else if (Implies* value = value_cast<Implies>(v.get())) {
     return !value2expr(value->left, consts, vars) || value2expr(value->right, consts, vars);
   }
-  else if (Apply* value = dynamic_cast<Apply*>(v.get())) {
+  else if (Apply* value = value_cast<Apply>(v.get())) {
     smt::expr_vector args(ctx->ctx);
     for (shared_ptr<Value> arg : value->args) {
       args.push_back(value2expr(arg, consts, vars));
     }
-    Const* func_value = dynamic_cast<Const*>(value->func.get());
+    Const* func_value = value_cast<Const>(value->func.get());
     assert(func_value != NULL);
     return getFunc(func_value->name).call(args);
   }
-  else if (And* value = dynamic_cast<And*>(v.get())) {
+  else if (And* value = value_cast<And>(v.get())) {
     if (value->args.size() == 0) {
       return ctx->ctx.bool_val(true);
     } else if (value->args.size() == 1) {
@@ -220,7 +222,7 @@ smt::expr ModelEmbedding::value2expr(
       return mk_and(args);
     }
   }
-  else if (Or* value = dynamic_cast<Or*>(v.get())) {
+  else if (Or* value = value_cast<Or>(v.get())) {
     if (value->args.size() == 0) {
       return ctx->ctx.bool_val(false);
     } else if (value->args.size() == 1) {
@@ -233,7 +235,7 @@ smt::expr ModelEmbedding::value2expr(
       return mk_or(args);
     }
   }
-  else if (IfThenElse* value = dynamic_cast<IfThenElse*>(v.get())) {
+  else if (IfThenElse* value = value_cast<IfThenElse>(v.get())) {
     return smt::ite(
         value2expr(value->cond, consts, vars),
         value2expr(value->then_value, consts, vars),
@@ -466,10 +468,10 @@ ActionResult applyAction(
   }
   else if (Assign* action = dynamic_cast<Assign*>(a.get())) {
     Value* left = action->left.get();
-    Apply* apply = dynamic_cast<Apply*>(left);
+    Apply* apply = value_cast<Apply>(left);
     //assert(apply != NULL);
 
-    Const* func_const = dynamic_cast<Const*>(apply != NULL ? apply->func.get() : left);
+    Const* func_const = value_cast<Const>(apply != NULL ? apply->func.get() : left);
     assert(func_const != NULL);
     smt::func_decl orig_func = e->getFunc(func_const->name);
 
@@ -487,7 +489,7 @@ ActionResult applyAction(
     for (int i = 0; i < (int)orig_func.arity(); i++) {
       assert(apply != NULL);
       shared_ptr<Value> arg = apply->args[i];
-      if (Var* arg_var = dynamic_cast<Var*>(arg.get())) {
+      if (Var* arg_var = value_cast<Var>(arg.get())) {
         expr qvar = ctx->ctx.bound_var(name(arg_var->name), ctx->getSort(arg_var->sort));
         qvars.push_back(qvar);
         vars.insert(make_pair(arg_var->name, qvar));
@@ -515,10 +517,10 @@ ActionResult applyAction(
   }
   else if (Havoc* action = dynamic_cast<Havoc*>(a.get())) {
     Value* left = action->left.get();
-    Apply* apply = dynamic_cast<Apply*>(left);
+    Apply* apply = value_cast<Apply>(left);
     //assert(apply != NULL);
 
-    Const* func_const = dynamic_cast<Const*>(apply != NULL ? apply->func.get() : left);
+    Const* func_const = value_cast<Const>(apply != NULL ? apply->func.get() : left);
     assert(func_const != NULL);
     smt::func_decl orig_func = e->getFunc(func_const->name);
 
@@ -536,7 +538,7 @@ ActionResult applyAction(
     for (int i = 0; i < (int)orig_func.arity(); i++) {
       assert(apply != NULL);
       shared_ptr<Value> arg = apply->args[i];
-      if (Var* arg_var = dynamic_cast<Var*>(arg.get())) {
+      if (Var* arg_var = value_cast<Var>(arg.get())) {
         expr qvar = ctx->ctx.bound_var(name(arg_var->name), ctx->getSort(arg_var->sort));
         qvars.push_back(qvar);
         vars.insert(make_pair(arg_var->name, qvar));
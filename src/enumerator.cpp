@@ -16,7 +16,7 @@ struct HoleInfo {
 
 void getHoleInfo_(value v, vector<VarDecl> decls, vector<HoleInfo>& res) {
   assert(v.get() != NULL);
-  if (Forall* va = dynamic_cast<Forall*>(v.get())) {
+  if (Forall* va = value_cast<Forall>(v.get())) {
     for (VarDecl decl : va->decls) {
       if (dynamic_cast<UninterpretedSort*>(decl.sort.get())) {
         decls.push_back(VarDecl(decl.name, decl.sort));
@@ -24,7 +24,7 @@ void getHoleInfo_(value v, vector<VarDecl> decls, vector<HoleInfo>& res) {
     }
     getHoleInfo_(va->body, decls, res);
   }
-  else if (Exists* va = dynamic_cast<Exists*>(v.get())) {
+  else if (Exists* va = value_cast<Exists>(v.get())) {
     for (VarDecl decl : va->decls) {
       if (dynamic_cast<UninterpretedSort*>(decl.sort.get())) {
         decls.push_back(VarDecl(decl.name, decl.sort));
@@ -32,40 +32,40 @@ void getHoleInfo_(value v, vector<VarDecl> decls, vector<HoleInfo>& res) {
     }
     getHoleInfo_(va->body, decls, res);
   }
-  else if (dynamic_cast<Var*>(v.get())) {
+  else if (value_cast<Var>(v.get())) {
     return;
   }
-  else if (dynamic_cast<Const*>(v.get())) {
+  else if (value_cast<Const>(v.get())) {
     return;
   }
-  else if (Eq* va = dynamic_cast<Eq*>(v.get())) {
+  else if (Eq* va = value_cast<Eq>(v.get())) {
     getHoleInfo_(va->left, decls, res);
     getHoleInfo_(va->right, decls, res);
   }
-  else if (Not* va = dynamic_cast<Not*>(v.get())) {
+  else if (Not* va = value_cast<Not>(v.get())) {
     getHoleInfo_(va->val, decls, res);
   }
-  else if (Implies* va = dynamic_cast<Implies*>(v.get())) {
+  else if (Implies* va = value_cast<Implies>(v.get())) {
     getHoleInfo_(va->left, decls, res);
     getHoleInfo_(va->right, decls, res);
   }
-  else if (Apply* va = dynamic_cast<Apply*>(v.get())) {
+  else if (Apply* va = value_cast<Apply>(v.get())) {
     getHoleInfo_(va->func, decls, res);
     for (value arg : va->args) {
       getHoleInfo_(arg, decls, res);
     }
   }
-  else if (And* va = dynamic_cast<And*>(v.get())) {
+  else if (And* va = value_cast<And>(v.get())) {
     for (value arg : va->args) {
       getHoleInfo_(arg, decls, res);
     }
   }
-  else if (Or* va = dynamic_cast<Or*>(v.get())) {
+  else if (Or* va = value_cast<Or>(v.get())) {
     for (value arg : va->args) {
       getHoleInfo_(arg, decls, res);
     }
   }
-  else if (dynamic_cast<TemplateHole*>(v.get())) {
+  else if (value_cast<TemplateHole>(v.get())) {
     HoleInfo hi;
     hi.decls = decls;
     res.push_back(hi);
@@ -84,36 +84,36 @@ vector<HoleInfo> getHoleInfo(value v) {
 
 value fill_holes_in_value(value templ, vector<value> const& fills, int& idx) {
   assert(templ.get() != NULL);
-  if (Forall* va = dynamic_cast<Forall*>(templ.get())) {
+  if (Forall* va = value_cast<Forall>(templ.get())) {
     return v_forall(va->decls, fill_holes_in_value(va->body, fills, idx));
   }
-  else if (Exists* va = dynamic_cast<Exists*>(templ.get())) {
+  else if (Exists* va = value_cast<Exists>(templ.get())) {
     return v_exists(va->decls, fill_holes_in_value(va->body, fills, idx));
   }
-  else if (NearlyForall* va = dynamic_cast<NearlyForall*>(templ.get())) {
+  else if (NearlyForall* va = value_cast<NearlyForall>(templ.get())) {
     return v_nearlyforall(va->decls, fill_holes_in_value(va->body, fills, idx));
   }
-  else if (dynamic_cast<Var*>(templ.get())) {
+  else if (value_cast<Var>(templ.get())) {
     return templ;
   }
-  else if (dynamic_cast<Const*>(templ.get())) {
+  else if (value_cast<Const>(templ.get())) {
     return templ;
   }
-  else if (Eq* va = dynamic_cast<Eq*>(templ.get())) {
+  else if (Eq* va = value_cast<Eq>(templ.get())) {
     return v_eq(
         fill_holes_in_value(va->left, fills, idx),
         fill_holes_in_value(va->right, fills, idx));
   }
-  else if (Not* va = dynamic_cast<Not*>(templ.get())) {
+  else if (Not* va = value_cast<Not>(templ.get())) {
     return v_not(
         fill_holes_in_value(va->val, fills, idx));
   }
-  else if (Implies* va = dynamic_cast<Implies*>(templ.get())) {
+  else if (Implies* va = value_cast<Implies>(templ.get())) {
     return v_implies(
         fill_holes_in_value(va->left, fills, idx),
         fill_holes_in_value(va->right, fills, idx));
   }
-  else if (Apply* va = dynamic_cast<Apply*>(templ.get())) {
+  else if (Apply* va = value_cast<Apply>(templ.get())) {
     value func = fill_holes_in_value(va->func, fills, idx);
     vector<value> args;
     for (value arg : va->args) {
@@ -121,21 +121,21 @@ value fill_holes_in_value(value templ, vector<value> const& fills, int& idx) {
     }
     return v_apply(func, args);
   }
-  else if (And* va = dynamic_cast<And*>(templ.get())) {
+  else if (And* va = value_cast<And>(templ.get())) {
     vector<value> args;
     for (value arg : va->args) {
       args.push_back(fill_holes_in_value(arg, fills, idx));
     }
     return v_and(args);
   }
-  else if (Or* va = dynamic_cast<Or*>(templ.get())) {
+  else if (Or* va = value_cast<Or>(templ.get())) {
     vector<value> args;
     for (value arg : va->args) {
       args.push_back(fill_holes_in_value(arg, fills, idx));
     }
     return v_or(args);
   }
-  else if (dynamic_cast<TemplateHole*>(templ.get())) {
+  else if (value_cast<TemplateHole>(templ.get())) {
     return fills[idx++];
   }
   else {
@@ -190,7 +190,7 @@ vector<value> fill_holes(value templ, vector<vector<value>> const& fills) {
 }
 
 bool are_negations1(value a, value b) {
-  if (Not* n = dynamic_cast<Not*>(a.get())) {
+  if (Not* n = value_cast<Not>(a.get())) {
     return values_equal(n->val, b);
   } else {
     return false;
@@ -237,30 +237,30 @@ vector<value> enum_conjuncts(vector<value> const& pieces, int k) {
 }
 
 bool is_boring(value v, bool pos) {
-  if (Not* va = dynamic_cast<Not*>(v.get())) {
+  if (Not* va = value_cast<Not>(v.get())) {
     return is_boring(va->val, !pos);
   }
-  else if (Eq* va = dynamic_cast<Eq*>(v.get())) {
+  else if (Eq* va = value_cast<Eq>(v.get())) {
     // FIXME to_string comparison is sketch
     return va->left->to_string() == va->right->to_string() ||
       (pos && (
-        dynamic_cast<Var*>(va->left.get()) != NULL ||
-        dynamic_cast<Var*>(va->right.get()) != NULL
+        value_cast<Var>(va->left.get()) != NULL ||
+        value_cast<Var>(va->right.get()) != NULL
       ));
     /*
-  } else if (And* va = dynamic_cast<And*>(v.get())) {
+  } else if (And* va = value_cast<And>(v.get())) {
     for (value arg : va->args) {
       if (is_boring(arg)) return true;
     }
     return false;
-  } else if (Or* va = dynamic_cast<Or*>(v.get())) {
+  } else if (Or* va = value_cast<Or>(v.get())) {
     for (value arg : va->args) {
       if (is_boring(arg)) return true;
     }
     return false;
     */
-  } else if (Apply* ap = dynamic_cast<Apply*>(v.get())) {
-    return (iden_to_string(dynamic_cast<Const*>(ap->func.get())->name) == "le" &&
+  } else if (Apply* ap = value_cast<Apply>(v.get())) {
+    return (iden_to_string(value_cast<Const>(ap->func.get())->name) == "le" &&
       ap->args[0]->to_string() == ap->args[1]->to_string());
   } else {
     return false;
@@ -294,33 +294,33 @@ struct NormalizeState {
 
 value normalize(value v, NormalizeState& ns) {
   assert(v.get() != NULL);
-  if (Forall* va = dynamic_cast<Forall*>(v.get())) {
+  if (Forall* va = value_cast<Forall>(v.get())) {
     return v_forall(va->decls, normalize(va->body, ns));
   }
-  else if (Exists* va = dynamic_cast<Exists*>(v.get())) {
+  else if (Exists* va = value_cast<Exists>(v.get())) {
     return v_exists(va->decls, normalize(va->body, ns));
   }
-  else if (Var* va = dynamic_cast<Var*>(v.get())) {
+  else if (Var* va = value_cast<Var>(v.get())) {
     return v_var(ns.get_name(va->name), va->sort);
   }
-  else if (dynamic_cast<Const*>(v.get())) {
+  else if (value_cast<Const>(v.get())) {
     return v;
   }
-  else if (Eq* va = dynamic_cast<Eq*>(v.get())) {
+  else if (Eq* va = value_cast<Eq>(v.get())) {
     return v_eq(
         normalize(va->left, ns),
         normalize(va->right, ns));
   }
-  else if (Not* va = dynamic_cast<Not*>(v.get())) {
+  else if (Not* va = value_cast<Not>(v.get())) {
     return v_not(
         normalize(va->val, ns));
   }
-  else if (Implies* va = dynamic_cast<Implies*>(v.get())) {
+  else if (Implies* va = value_cast<Implies>(v.get())) {
     return v_implies(
         normalize(va->left, ns),
         normalize(va->right, ns));
   }
-  else if (Apply* va = dynamic_cast<Apply*>(v.get())) {
+  else if (Apply* va = value_cast<Apply>(v.get())) {
     value func = normalize(va->func, ns);
     vector<value> args;
     for (value arg : va->args) {
@@ -328,14 +328,14 @@ value normalize(value v, NormalizeState& ns) {
     }
     return v_apply(func, args);
   }
-  else if (And* va = dynamic_cast<And*>(v.get())) {
+  else if (And* va = value_cast<And>(v.get())) {
     vector<value> args;
     for (value arg : va->args) {
       args.push_back(normalize(arg, ns));
     }
     return v_and(args);
   }
-  else if (Or* va = dynamic_cast<Or*>(v.get())) {
+  else if (Or* va = value_cast<Or>(v.get())) {
     vector<value> args;
     for (value arg : va->args) {
       args.push_back(normalize(arg, ns));
@@ -374,7 +374,7 @@ value normalize(value v, NormalizeState& ns) {
 // so we still do the first one to save time.
 vector<value> remove_equiv2(vector<value> const& values) {
   vector<value> result;
-  set<ComparableValue> seen;
+  ValueInterner seen;
   int i = 0;
   for (value v : values) {
     i++;
@@ -386,10 +386,7 @@ vector<value> remove_equiv2(vector<value> const& values) {
     //cout << s << endl;
     //cout << endl;
 
-    ComparableValue cv(norm);
-
-    if (seen.find(cv) == seen.end()) {
-      seen.insert(cv);
+    if (seen.insert(norm)) {
       result.push_back(v);
     }
   }
@@ -35,20 +35,29 @@ bool is_necessary(
   return csr.res != smt::SolverResult::Unsat;
 }
 
+// Appends each of `values0` not equal to an earlier one. Candidates are
+// compared in full only when their fingerprints match.
+static void add_unique_formulas(
+  vector<value>& values,
+  vector<value> const& values0)
+{
+  FingerprintSet fps;
+  for (value const& v : values0) {
+    uint64_t fp = value_fingerprint(v);
+    if (!fps.find_if(fp, [&](int id) { return values_equal(values[id], v); })) {
+      fps.insert(fp, values.size());
+      values.push_back(v);
+    }
+  }
+}
+
 vector<value> filter_redundant_formulas(
   shared_ptr<Module> module,
   vector<value> const& values0)
 {
   vector<value> values;
 
-  set<ComparableValue> cvs;
-  for (int i = 0; i < (int)values0.size(); i++) {
-    ComparableValue cv(values0[i]);
-    if (cvs.find(cv) == cvs.end()) {
-      values.push_back(values0[i]);
-      cvs.insert(values0[i]);
-    }
-  }
+  add_unique_formulas(values, values0);
 
   for (int i = 0; i < (int)values.size(); i++) {
     if (!is_necessary(module, values, i)) {
@@ -68,14 +77,7 @@ vector<value> filter_unique_formulas(
 {
   vector<value> values;
 
-  set<ComparableValue> cvs;
-  for (int i = 0; i < (int)values0.size(); i++) {
-    ComparableValue cv(values0[i]);
-    if (cvs.find(cv) == cvs.end()) {
-      values.push_back(values0[i]);
-      cvs.insert(values0[i]);
-    }
-  }
+  add_unique_formulas(values, values0);
 
   return values;
 }
@@ -459,7 +459,7 @@ string Eq::to_string() const {
 }
 
 string Not::to_string() const {
-  if (Eq* e = dynamic_cast<Eq*>(val.get())) {
+  if (Eq* e = value_cast<Eq>(val.get())) {
     return "(" + e->left->to_string() + ") ~= (" + e->right->to_string() + ")";
   } else {
     return "~(" + val->to_string() + ")";
@@ -529,7 +529,7 @@ lsort Eq::get_sort() const { return bsort; }
 lsort Not::get_sort() const { return bsort; }
 lsort Implies::get_sort() const { return bsort; }
 lsort Apply::get_sort() const {
-  Const* f = dynamic_cast<Const*>(func.get());
+  Const* f = value_cast<Const>(func.get());
   assert(f != NULL);
   return f->sort->get_range_as_function();
 }
@@ -649,7 +649,7 @@ value Apply::subst_fun(iden f, vector<VarDecl> const& d, value e) const {
     new_args.push_back(v->subst_fun(f, d, e));
   }
 
-  Const* c = dynamic_cast<Const*>(func.get());
+  Const* c = value_cast<Const>(func.get());
   assert (c != NULL);
   if (c->name == f) {
     value res = e;
@@ -820,12 +820,12 @@ value Implies::simplify() const {
 }
 
 bool is_const_true(value v) {
-  And* a = dynamic_cast<And*>(v.get());
+  And* a = value_cast<And>(v.get());
   return a != NULL && a->args.size() == 0;
 }
 
 bool is_const_false(value v) {
-  Or* a = dynamic_cast<Or*>(v.get());
+  Or* a = value_cast<Or>(v.get());
   return a != NULL && a->args.size() == 0;
 }
 
@@ -857,7 +857,7 @@ value And::simplify() const {
   vector<value> a;
   for (value v : args) {
     v = v->simplify();
-    if (And* inner = dynamic_cast<And*>(v.get())) {
+    if (And* inner = value_cast<And>(v.get())) {
       extend(a, inner->args);
     }
     else if (is_const_false(v)) {
@@ -878,7 +878,7 @@ value Or::simplify() const {
   vector<value> a;
   for (value v : args) {
     v = v->simplify();
-    if (Or* inner = dynamic_cast<Or*>(v.get())) {
+    if (Or* inner = value_cast<Or>(v.get())) {
       extend(a, inner->args);
     }
     else if (is_const_true(v)) {
@@ -1048,7 +1048,7 @@ void sort_decls(vector<VarDecl>& decls) {
 
 value Forall::structurally_normalize_() const {
   value b = this->body->structurally_normalize_();
-  if (Forall* inner = dynamic_cast<Forall*>(b.get())) {
+  if (Forall* inner = value_cast<Forall>(b.get())) {
     vector<VarDecl> new_decls = this->decls;
     extend(new_decls, inner->decls);
     sort_decls(new_decls);
@@ -1065,7 +1065,7 @@ value NearlyForall::structurally_normalize_() const {
 
 value Exists::structurally_normalize_() const {
   value b = this->body->structurally_normalize_();
-  if (Exists* inner = dynamic_cast<Exists*>(b.get())) {
+  if (Exists* inner = value_cast<Exists>(b.get())) {
     vector<VarDecl> new_decls = this->decls;
     extend(new_decls, inner->decls);
     sort_decls(new_decls);
@@ -1104,8 +1104,8 @@ value Apply::structurally_normalize_() const {
 }
 
 value structurally_normalize_and_or_or(Value const * the_value) {
-  And const * the_and = dynamic_cast<And const*>(the_value);
-  Or const * the_or = dynamic_cast<Or const*>(the_value);
+  And const * the_and = value_cast<And>(the_value);
+  Or const * the_or = value_cast<Or>(the_value);
 
   vector<value> args = the_and ? the_and->args : the_or->args;
 
@@ -1118,12 +1118,12 @@ value structurally_normalize_and_or_or(Value const * the_value) {
     vector<value> new_args;
     bool found = false;
     for (value arg : args) {
-      if (Forall* forall = dynamic_cast<Forall*>(arg.get())) {
+      if (Forall* forall = value_cast<Forall>(arg.get())) {
         extend(forall_decls, forall->decls);
         arg = forall->body;
         found = true;
       }
-      if (Exists* exists = dynamic_cast<Exists*>(arg.get())) {
+      if (Exists* exists = value_cast<Exists>(arg.get())) {
         extend(exists_decls, exists->decls);
         arg = exists->body;
         found = true;
@@ -1142,9 +1142,9 @@ value structurally_normalize_and_or_or(Value const * the_value) {
   for (value arg : args) {
     And* sub_and;
     Or* sub_or;
-    if (the_and && (sub_and = dynamic_cast<And*>(arg.get()))) {
+    if (the_and && (sub_and = value_cast<And>(arg.get()))) {
       extend(new_args, sub_and->args);
-    } else if (the_or && (sub_or = dynamic_cast<Or*>(arg.get()))) {
+    } else if (the_or && (sub_or = value_cast<Or>(arg.get()))) {
       extend(new_args, sub_or->args);
     } else {
       new_args.push_back(arg);
@@ -1313,11 +1313,11 @@ value forall_exists_normalize_symmetries(
   } while (next_permutation(perm.begin() + perm_start, perm.begin() + perm_end));
 
   if (idx_end < (int)decls.size()) {
-    if (Forall* inner = dynamic_cast<Forall*>(smallest.get())) {
+    if (Forall* inner = value_cast<Forall>(smallest.get())) {
       smallest = inner->body;
       extend(smallest_decls, inner->decls);
     }
-    else if (Exists* inner = dynamic_cast<Exists*>(smallest.get())) {
+    else if (Exists* inner = value_cast<Exists>(smallest.get())) {
       smallest = inner->body;
       extend(smallest_decls, inner->decls);
     }
@@ -1411,8 +1411,8 @@ int cmp_expr(value a_, value b_, ScopeState const& ss_a, ScopeState const& ss_b)
   int b_id = b_->kind_id();
   if (a_id != b_id) return a_id < b_id ? -1 : 1;
 
-  if (Forall* a = dynamic_cast<Forall*>(a_.get())) {
-    Forall* b = dynamic_cast<Forall*>(b_.get());
+  if (Forall* a = value_cast<Forall>(a_.get())) {
+    Forall* b = value_cast<Forall>(b_.get());
     assert(b != NULL);
   
     if (a->decls.size() < b->decls.size()) return -1;
@@ -1430,8 +1430,8 @@ int cmp_expr(value a_, value b_, ScopeState const& ss_a, ScopeState const& ss_b)
     return cmp_expr(a->body, b->body, ss_a_new, ss_b_new);
   }
 
-  if (Exists* a = dynamic_cast<Exists*>(a_.get())) {
-    Exists* b = dynamic_cast<Exists*>(b_.get());
+  if (Exists* a = value_cast<Exists>(a_.get())) {
+    Exists* b = value_cast<Exists>(b_.get());
     assert(b != NULL);
   
     if (a->decls.size() < b->decls.size()) return -1;
@@ -1448,8 +1448,8 @@ int cmp_expr(value a_, value b_, ScopeState const& ss_a, ScopeState const& ss_b)
     return cmp_expr(a->body, b->body, ss_a_new, ss_b_new);
   }
 
-  if (Var* a = dynamic_cast<Var*>(a_.get())) {
-    Var* b = dynamic_cast<Var*>(b_.get());
+  if (Var* a = value_cast<Var>(a_.get())) {
+    Var* b = value_cast<Var>(b_.get());
     assert(b != NULL);
 
     int a_idx = -1, b_idx = -1;
@@ -1486,8 +1486,8 @@ int cmp_expr(value a_, value b_, ScopeState const& ss_a, ScopeState const& ss_b)
     }
   }
 
-  if (Const* a = dynamic_cast<Const*>(a_.get())) {
-    Const* b = dynamic_cast<Const*>(b_.get());
+  if (Const* a = value_cast<Const>(a_.get())) {
+    Const* b = value_cast<Const>(b_.get());
     assert(b != NULL);
 
     string a_name = iden_to_string(a->name);
@@ -1495,31 +1495,31 @@ int cmp_expr(value a_, value b_, ScopeState const& ss_a, ScopeState const& ss_b)
     return a_name < b_name ? -1 : (a_name == b_name ? 0 : 1);
   }
 
-  if (Eq* a = dynamic_cast<Eq*>(a_.get())) {
-    Eq* b = dynamic_cast<Eq*>(b_.get());
+  if (Eq* a = value_cast<Eq>(a_.get())) {
+    Eq* b = value_cast<Eq>(b_.get());
     assert(b != NULL);
 
     if (int c = cmp_expr(a->left, b->left, ss_a, ss_b)) return c;
     return cmp_expr(a->right, b->right, ss_a, ss_b);
   }
 
-  if (Not* a = dynamic_cast<Not*>(a_.get())) {
-    Not* b = dynamic_cast<Not*>(b_.get());
+  if (Not* a = value_cast<Not>(a_.get())) {
+    Not* b = value_cast<Not>(b_.get());
     assert(b != NULL);
 
     return cmp_expr(a->val, b->val, ss_a, ss_b);
   }
 
-  if (Implies* a = dynamic_cast<Implies*>(a_.get())) {
-    Implies* b = dynamic_cast<Implies*>(b_.get());
+  if (Implies* a = value_cast<Implies>(a_.get())) {
+    Implies* b = value_cast<Implies>(b_.get());
     assert(b != NULL);
 
     if (int c = cmp_expr(a->left, b->left, ss_a, ss_b)) return c;
     return cmp_expr(a->right, b->right, ss_a, ss_b);
   }
 
-  if (Apply* a = dynamic_cast<Apply*>(a_.get())) {
-    Apply* b = dynamic_cast<Apply*>(b_.get());
+  if (Apply* a = value_cast<Apply>(a_.get())) {
+    Apply* b = value_cast<Apply>(b_.get());
     assert(b != NULL);
 
     if (int c = cmp_expr(a->func, b->func, ss_a, ss_b)) return c;
@@ -1536,8 +1536,8 @@ int cmp_expr(value a_, value b_, ScopeState const& ss_a, ScopeState const& ss_b)
     return 0;
   }
 
-  if (And* a = dynamic_cast<And*>(a_.get())) {
-    And* b = dynamic_cast<And*>(b_.get());
+  if (And* a = value_cast<And>(a_.get())) {
+    And* b = value_cast<And>(b_.get());
     assert(b != NULL);
 
     if (a->args.size() < b->args.size()) return -1;
@@ -1552,8 +1552,8 @@ int cmp_expr(value a_, value b_, ScopeState const& ss_a, ScopeState const& ss_b)
     return 0;
   }
 
-  if (Or* a = dynamic_cast<Or*>(a_.get())) {
-    Or* b = dynamic_cast<Or*>(b_.get());
+  if (Or* a = value_cast<Or>(a_.get())) {
+    Or* b = value_cast<Or>(b_.get());
     assert(b != NULL);
 
     if (a->args.size() < b->args.size()) return -1;
@@ -1568,8 +1568,8 @@ int cmp_expr(value a_, value b_, ScopeState const& ss_a, ScopeState const& ss_b)
     return 0;
   }
 
-  if (dynamic_cast<TemplateHole*>(a_.get())) {
-    TemplateHole* b = dynamic_cast<TemplateHole*>(b_.get());
+  if (value_cast<TemplateHole>(a_.get())) {
+    TemplateHole* b = value_cast<TemplateHole>(b_.get());
     assert(b != NULL);
     return 0;
   }
@@ -1587,55 +1587,431 @@ bool lt_value(value a_, value b_) {
   return cmp_expr(a_, b_, ss_a, ss_b) < 0;
 }
 
+thread_local ValueArena* current_value_arena = NULL;
+
+static const size_t VALUE_ARENA_BLOCK_SIZE = 1 << 16;
+
+void ValueArena::next_block(size_t n) {
+  while (block_idx < (int)blocks.size() && blocks[block_idx].second < n) {
+    block_idx++;
+  }
+  if (block_idx == (int)blocks.size()) {
+    size_t sz = max(n, VALUE_ARENA_BLOCK_SIZE);
+    blocks.push_back(make_pair(unique_ptr<char[]>(new char[sz]), sz));
+  }
+  cur = blocks[block_idx].first.get();
+  left = blocks[block_idx].second;
+  block_idx++;
+}
+
+void ValueArena::reset() {
+  block_idx = 0;
+  cur = NULL;
+  left = 0;
+}
+
+bool ValueArena::owns(void const* p) const {
+  char const* c = static_cast<char const*>(p);
+  for (auto const& b : blocks) {
+    if (c >= b.first.get() && c < b.first.get() + b.second) {
+      return true;
+    }
+  }
+  return false;
+}
+
+ValueArena::Scope::Scope(ValueArena& arena) : arena(arena) {
+  prev = current_value_arena;
+  current_value_arena = &arena;
+}
+
+ValueArena::Scope::~Scope() {
+  current_value_arena = prev;
+  arena.reset();
+}
+
+value ValueArena::promote(value v) const {
+  ValueArena* prev = current_value_arena;
+  current_value_arena = NULL;
+  value res = promote_rec(v);
+  current_value_arena = prev;
+  return res;
+}
+
+vector<value> ValueArena::promote_all(vector<value> const& vs) const {
+  vector<value> res;
+  for (value const& v : vs) {
+    res.push_back(promote_rec(v));
+  }
+  return res;
+}
+
+value ValueArena::promote_rec(value v) const {
+  if (!owns(v.get())) {
+    return v;
+  }
+  switch (v->kind) {
+    case ValueKind::Forall: {
+      Forall* a = static_cast<Forall*>(v.get());
+      return make_value<Forall>(a->decls, promote_rec(a->body));
+    }
+    case ValueKind::NearlyForall: {
+      NearlyForall* a = static_cast<NearlyForall*>(v.get());
+      return make_value<NearlyForall>(a->decls, promote_rec(a->body));
+    }
+    case ValueKind::Exists: {
+      Exists* a = static_cast<Exists*>(v.get());
+      return make_value<Exists>(a->decls, promote_rec(a->body));
+    }
+    case ValueKind::Var: {
+      Var* a = static_cast<Var*>(v.get());
+      return make_value<Var>(a->name, a->sort);
+    }
+    case ValueKind::Const: {
+      Const* a = static_cast<Const*>(v.get());
+      return make_value<Const>(a->name, a->sort);
+    }
+    case ValueKind::Eq: {
+      Eq* a = static_cast<Eq*>(v.get());
+      return make_value<Eq>(promote_rec(a->left), promote_rec(a->right));
+    }
+    case ValueKind::Not: {
+      Not* a = static_cast<Not*>(v.get());
+      return make_value<Not>(promote_rec(a->val));
+    }
+    case ValueKind::Implies: {
+      Implies* a = static_cast<Implies*>(v.get());
+      return make_value<Implies>(promote_rec(a->left), promote_rec(a->right));
+    }
+    case ValueKind::Apply: {
+      Apply* a = static_cast<Apply*>(v.get());
+      return make_value<Apply>(promote_rec(a->func), promote_all(a->args));
+    }
+    case ValueKind::And:
+      return make_value<And>(promote_all(static_cast<And*>(v.get())->args));
+    case ValueKind::Or:
+      return make_value<Or>(promote_all(static_cast<Or*>(v.get())->args));
+    case ValueKind::IfThenElse: {
+      IfThenElse* a = static_cast<IfThenElse*>(v.get());
+      return make_value<IfThenElse>(promote_rec(a->cond),
+          promote_rec(a->then_value), promote_rec(a->else_value));
+    }
+    case ValueKind::TemplateHole:
+      return make_value<TemplateHole>();
+  }
+  assert(false);
+}
+
+size_t ValueInterner::KeyHash::operator()(vector<int> const& key) const {
+  uint64_t h = 14695981039346656037ULL;
+  for (int x : key) {
+    h ^= (uint32_t)x;
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+int ValueInterner::sort_id(lsort s) {
+  if (dynamic_cast<BooleanSort*>(s.get())) {
+    return 0;
+  }
+  UninterpretedSort* usort = dynamic_cast<UninterpretedSort*>(s.get());
+  assert(usort != NULL);
+  auto iter = sort_ids.find(usort->name);
+  if (iter != sort_ids.end()) {
+    return iter->second;
+  }
+  int id = sort_ids.size() + 1;
+  sort_ids.insert(make_pair(usort->name, id));
+  return id;
+}
+
+int ValueInterner::get_id(value v, vector<VarDecl> const& scope, bool insert) {
+  vector<int> key;
+  key.push_back(v->kind_id());
+
+  auto child = [&](value c, vector<VarDecl> const& sc) {
+    int id = get_id(c, sc, insert);
+    key.push_back(id);
+    return id != -1;
+  };
+  auto children = [&](vector<value> const& args) {
+    key.push_back(args.size());
+    for (value const& arg : args) {
+      if (!child(arg, scope)) return false;
+    }
+    return true;
+  };
+  auto quantifier = [&](vector<VarDecl> const& decls, value body) {
+    vector<VarDecl> new_scope = scope;
+    key.push_back(decls.size());
+    for (VarDecl const& decl : decls) {
+      key.push_back(sort_id(decl.sort));
+      new_scope.push_back(decl);
+    }
+    return child(body, new_scope);
+  };
+
+  bool found;
+  if (Forall* a = value_cast<Forall>(v.get())) {
+    found = quantifier(a->decls, a->body);
+  }
+  else if (Exists* a = value_cast<Exists>(v.get())) {
+    found = quantifier(a->decls, a->body);
+  }
+  else if (NearlyForall* a = value_cast<NearlyForall>(v.get())) {
+    found = quantifier(a->decls, a->body);
+  }
+  else if (Var* a = value_cast<Var>(v.get())) {
+    int idx = -1;
+    for (int i = 0; i < (int)scope.size(); i++) {
+      if (scope[i].name == a->name) {
+        idx = i;
+        break;
+      }
+    }
+    if (idx == -1) {
+      key.push_back(0);
+      key.push_back(a->name);
+    } else {
+      key.push_back(1);
+      key.push_back(idx);
+    }
+    found = true;
+  }
+  else if (Const* a = value_cast<Const>(v.get())) {
+    key.push_back(a->name);
+    found = true;
+  }
+  else if (Eq* a = value_cast<Eq>(v.get())) {
+    found = child(a->left, scope) && child(a->right, scope);
+  }
+  else if (Not* a = value_cast<Not>(v.get())) {
+    found = child(a->val, scope);
+  }
+  else if (Implies* a = value_cast<Implies>(v.get())) {
+    found = child(a->left, scope) && child(a->right, scope);
+  }
+  else if (Apply* a = value_cast<Apply>(v.get())) {
+    found = child(a->func, scope) && children(a->args);
+  }
+  else if (And* a = value_cast<And>(v.get())) {
+    found = children(a->args);
+  }
+  else if (Or* a = value_cast<Or>(v.get())) {
+    found = children(a->args);
+  }
+  else if (IfThenElse* a = value_cast<IfThenElse>(v.get())) {
+    found = child(a->cond, scope) && child(a->then_value, scope)
+        && child(a->else_value, scope);
+  }
+  else if (value_cast<TemplateHole>(v.get())) {
+    found = true;
+  }
+  else {
+    assert(false);
+  }
+
+  if (!found) {
+    return -1;
+  }
+
+  auto iter = table.find(key);
+  if (iter != table.end()) {
+    return iter->second;
+  }
+  if (!insert) {
+    return -1;
+  }
+  int id = nodes.size();
+  nodes.push_back(v);
+  table.insert(make_pair(move(key), id));
+  return id;
+}
+
+static uint64_t fp_mix(uint64_t h, uint64_t x) {
+  h ^= x + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+  return h;
+}
+
+static uint64_t fp_sort(lsort s) {
+  if (UninterpretedSort* usort = dynamic_cast<UninterpretedSort*>(s.get())) {
+    return std::hash<string>()(usort->name);
+  }
+  return 0;
+}
+
+static uint64_t value_fingerprint(value v, vector<iden>& scope) {
+  uint64_t h = fp_mix(0, v->kind_id());
+
+  auto children = [&](vector<value> const& args) {
+    h = fp_mix(h, args.size());
+    for (value const& arg : args) {
+      h = fp_mix(h, value_fingerprint(arg, scope));
+    }
+  };
+  auto quantifier = [&](vector<VarDecl> const& decls, value body) {
+    h = fp_mix(h, decls.size());
+    for (VarDecl const& decl : decls) {
+      h = fp_mix(h, fp_sort(decl.sort));
+      scope.push_back(decl.name);
+    }
+    h = fp_mix(h, value_fingerprint(body, scope));
+    scope.resize(scope.size() - decls.size());
+  };
+
+  switch (v->kind) {
+    case ValueKind::Forall:
+      quantifier(static_cast<Forall*>(v.get())->decls,
+          static_cast<Forall*>(v.get())->body);
+      break;
+    case ValueKind::NearlyForall:
+      quantifier(static_cast<NearlyForall*>(v.get())->decls,
+          static_cast<NearlyForall*>(v.get())->body);
+      break;
+    case ValueKind::Exists:
+      quantifier(static_cast<Exists*>(v.get())->decls,
+          static_cast<Exists*>(v.get())->body);
+      break;
+    case ValueKind::Var: {
+      iden name = static_cast<Var*>(v.get())->name;
+      int idx = -1;
+      for (int i = 0; i < (int)scope.size(); i++) {
+        if (scope[i] == name) {
+          idx = i;
+          break;
+        }
+      }
+      h = idx == -1 ? fp_mix(fp_mix(h, 0), name) : fp_mix(fp_mix(h, 1), idx);
+      break;
+    }
+    case ValueKind::Const:
+      h = fp_mix(h, static_cast<Const*>(v.get())->name);
+      break;
+    case ValueKind::Eq: {
+      Eq* a = static_cast<Eq*>(v.get());
+      h = fp_mix(h, value_fingerprint(a->left, scope));
+      h = fp_mix(h, value_fingerprint(a->right, scope));
+      break;
+    }
+    case ValueKind::Not:
+      h = fp_mix(h, value_fingerprint(static_cast<Not*>(v.get())->val, scope));
+      break;
+    case ValueKind::Implies: {
+      Implies* a = static_cast<Implies*>(v.get());
+      h = fp_mix(h, value_fingerprint(a->left, scope));
+      h = fp_mix(h, value_fingerprint(a->right, scope));
+      break;
+    }
+    case ValueKind::Apply: {
+      Apply* a = static_cast<Apply*>(v.get());
+      h = fp_mix(h, value_fingerprint(a->func, scope));
+      children(a->args);
+      break;
+    }
+    case ValueKind::And:
+      children(static_cast<And*>(v.get())->args);
+      break;
+    case ValueKind::Or:
+      children(static_cast<Or*>(v.get())->args);
+      break;
+    case ValueKind::IfThenElse: {
+      IfThenElse* a = static_cast<IfThenElse*>(v.get());
+      h = fp_mix(h, value_fingerprint(a->cond, scope));
+      h = fp_mix(h, value_fingerprint(a->then_value, scope));
+      h = fp_mix(h, value_fingerprint(a->else_value, scope));
+      break;
+    }
+    case ValueKind::TemplateHole:
+      break;
+  }
+  return h;
+}
+
+uint64_t value_fingerprint(value v) {
+  vector<iden> scope;
+  return value_fingerprint(v, scope);
+}
+
+void FingerprintSet::insert(uint64_t fp, int id) {
+  assert(id >= 0);
+  if (2 * (count + 1) > (int)slots.size()) {
+    grow();
+  }
+  size_t mask = slots.size() - 1;
+  size_t i = fp & mask;
+  while (slots[i].id != -1) {
+    i = (i + 1) & mask;
+  }
+  slots[i].fp = fp;
+  slots[i].id = id;
+  count++;
+}
+
+bool FingerprintSet::contains(uint64_t fp) const {
+  return find_if(fp, [](int) { return true; });
+}
+
+void FingerprintSet::grow() {
+  vector<Slot> old = move(slots);
+  slots = vector<Slot>(old.size() * 2);
+  count = 0;
+  for (Slot const& slot : old) {
+    if (slot.id != -1) {
+      insert(slot.fp, slot.id);
+    }
+  }
+}
+
 int cmp_expr_def(value a_, value b_) {
   int a_id = a_->kind_id();
   int b_id = b_->kind_id();
   if (a_id != b_id) return a_id < b_id ? -1 : 1;
 
-  if (Forall* a = dynamic_cast<Forall*>(a_.get())) {
-    Forall* b = dynamic_cast<Forall*>(b_.get());
+  if (Forall* a = value_cast<Forall>(a_.get())) {
+    Forall* b = value_cast<Forall>(b_.get());
     assert(b != NULL);
     return cmp_expr_def(a->body, b->body);
   }
 
-  if (Exists* a = dynamic_cast<Exists*>(a_.get())) {
-    Exists* b = dynamic_cast<Exists*>(b_.get());
+  if (Exists* a = value_cast<Exists>(a_.get())) {
+    Exists* b = value_cast<Exists>(b_.get());
     assert(b != NULL);
   
     return cmp_expr_def(a->body, b->body);
   }
 
-  if (dynamic_cast<Var*>(a_.get())) {
+  if (value_cast<Var>(a_.get())) {
     return 0;
   }
 
-  if (Const* a = dynamic_cast<Const*>(a_.get())) {
-    Const* b = dynamic_cast<Const*>(b_.get());
+  if (Const* a = value_cast<Const>(a_.get())) {
+    Const* b = value_cast<Const>(b_.get());
     assert(b != NULL);
 
     return a->name < b->name ? -1 : (a->name == b->name ? 0 : 1);
   }
 
-  if (dynamic_cast<Eq*>(a_.get())) {
-    Eq* b = dynamic_cast<Eq*>(b_.get());
+  if (value_cast<Eq>(a_.get())) {
+    Eq* b = value_cast<Eq>(b_.get());
     assert(b != NULL);
 
     return 0;
   }
 
-  if (Not* a = dynamic_cast<Not*>(a_.get())) {
-    Not* b = dynamic_cast<Not*>(b_.get());
+  if (Not* a = value_cast<Not>(a_.get())) {
+    Not* b = value_cast<Not>(b_.get());
     assert(b != NULL);
 
     return cmp_expr_def(a->val, b->val);
   }
 
-  if (dynamic_cast<Implies*>(a_.get())) {
+  if (value_cast<Implies>(a_.get())) {
     assert(false);
   }
 
-  if (Apply* a = dynamic_cast<Apply*>(a_.get())) {
-    Apply* b = dynamic_cast<Apply*>(b_.get());
+  if (Apply* a = value_cast<Apply>(a_.get())) {
+    Apply* b = value_cast<Apply>(b_.get());
     assert(b != NULL);
 
     if (int c = cmp_expr_def(a->func, b->func)) return c;
@@ -1652,11 +2028,11 @@ int cmp_expr_def(value a_, value b_) {
     return 0;
   }
 
-  if (dynamic_cast<And*>(a_.get())) {
+  if (value_cast<And>(a_.get())) {
     return 0;
   }
 
-  if (dynamic_cast<Or*>(a_.get())) {
+  if (value_cast<Or>(a_.get())) {
     return 0;
   }
 
@@ -1669,15 +2045,15 @@ bool get_certain_variable_order(
     vector<iden> & res,
     int n)
 {
-  if (Forall* a = dynamic_cast<Forall*>(a_.get())) {
+  if (Forall* a = value_cast<Forall>(a_.get())) {
     return get_certain_variable_order(a->body, d, res, n);
   }
 
-  else if (Exists* a = dynamic_cast<Exists*>(a_.get())) {
+  else if (Exists* a = value_cast<Exists>(a_.get())) {
     return get_certain_variable_order(a->body, d, res, n);
   }
 
-  else if (Var* a = dynamic_cast<Var*>(a_.get())) {
+  else if (Var* a = value_cast<Var>(a_.get())) {
     for (int i = 0; i < (int)d.size(); i++) {
       if (d[i].name == a->name) {
         bool contains = false;
@@ -1697,11 +2073,11 @@ bool get_certain_variable_order(
     return true;
   }
 
-  else if (dynamic_cast<Const*>(a_.get())) {
+  else if (value_cast<Const>(a_.get())) {
     return true;
   }
 
-  else if (Eq* a = dynamic_cast<Eq*>(a_.get())) {
+  else if (Eq* a = value_cast<Eq>(a_.get())) {
     int c = cmp_expr_def(a->left, a->right);
     if (c == -1) {
       if (!get_certain_variable_order(a->left, d, res, n)) return false;
@@ -1722,7 +2098,7 @@ bool get_certain_variable_order(
       if (okay && (int)res.size() <= cur_size + 1) {
         return true;
       } else if (okay && (int)res.size() == n && cur_size == n - 2 &&
-          dynamic_cast<Var*>(a->left.get()) && dynamic_cast<Var*>(a->right.get())) {
+          value_cast<Var>(a->left.get()) && value_cast<Var>(a->right.get())) {
         // A=B case where A and B are the last two 
         // In this case, we learn nothing about the ordering from this term.
         res.resize(cur_size);
@@ -1734,15 +2110,15 @@ bool get_certain_variable_order(
     }
   }
 
-  if (Not* a = dynamic_cast<Not*>(a_.get())) {
+  if (Not* a = value_cast<Not>(a_.get())) {
     return get_certain_variable_order(a->val, d, res, n);
   }
 
-  if (dynamic_cast<Implies*>(a_.get())) {
+  if (value_cast<Implies>(a_.get())) {
     assert(false);
   }
 
-  if (Apply* a = dynamic_cast<Apply*>(a_.get())) {
+  if (Apply* a = value_cast<Apply>(a_.get())) {
     if (!get_certain_variable_order(a->func, d, res, n)) return false;
     for (value arg : a->args) {
       if (!get_certain_variable_order(arg, d, res, n)) return false;
@@ -1750,14 +2126,14 @@ bool get_certain_variable_order(
     return true;
   }
 
-  if (And* a = dynamic_cast<And*>(a_.get())) {
+  if (And* a = value_cast<And>(a_.get())) {
     for (value arg : a->args) {
       if (!get_certain_variable_order(arg, d, res, n)) return false;
     }
     return true;
   }
 
-  if (Or* a = dynamic_cast<Or*>(a_.get())) {
+  if (Or* a = value_cast<Or>(a_.get())) {
     for (value arg : a->args) {
       if (!get_certain_variable_order(arg, d, res, n)) return false;
     }
@@ -1773,10 +2149,10 @@ vector<iden> get_front_quantifier_order(
     set<iden> const& vars_used)
 {
   while (true) {
-    if (Forall* b = dynamic_cast<Forall*>(body.get())) {
+    if (Forall* b = value_cast<Forall>(body.get())) {
       body = b->body;
     }
-    else if (Exists* b = dynamic_cast<Exists*>(body.get())) {
+    else if (Exists* b = value_cast<Exists>(body.get())) {
       body = b->body;
     }
     else {
@@ -1785,10 +2161,10 @@ vector<iden> get_front_quantifier_order(
   }
 
   vector<value> juncts;
-  if (And* b = dynamic_cast<And*>(body.get())) {
+  if (And* b = value_cast<And>(body.get())) {
     juncts = b->args;
   }
-  else if (Or* b = dynamic_cast<Or*>(body.get())) {
+  else if (Or* b = value_cast<Or>(body.get())) {
     juncts = b->args;
   }
   else {
@@ -2087,7 +2463,7 @@ bool values_equal(value a, value b) {
 
 value remove_unneeded_quants(Value const * v) {
   assert(v != NULL);
-  if (Forall const* value = dynamic_cast<Forall const*>(v)) {
+  if (Forall const* value = value_cast<Forall>(v)) {
     vector<VarDecl> decls;
     for (VarDecl const& decl : value->decls) {
       if (value->uses_var(decl.name)) {
@@ -2097,7 +2473,7 @@ value remove_unneeded_quants(Value const * v) {
     auto b = remove_unneeded_quants(value->body.get());
     return decls.size() > 0 ? v_forall(decls, b) : b;
   }
-  else if (Exists const* value = dynamic_cast<Exists const*>(v)) {
+  else if (Exists const* value = value_cast<Exists>(v)) {
     vector<VarDecl> decls;
     for (VarDecl const& decl : value->decls) {
       if (value->uses_var(decl.name)) {
@@ -2107,43 +2483,43 @@ value remove_unneeded_quants(Value const * v) {
     auto b = remove_unneeded_quants(value->body.get());
     return decls.size() > 0 ? v_exists(decls, b) : b;
   }
-  else if (NearlyForall const* value = dynamic_cast<NearlyForall const*>(v)) {
+  else if (NearlyForall const* value = value_cast<NearlyForall>(v)) {
     return v_nearlyforall(value->decls, remove_unneeded_quants(value->body.get()));
   }
-  else if (Var const* value = dynamic_cast<Var const*>(v)) {
+  else if (Var const* value = value_cast<Var>(v)) {
     return v_var(value->name, value->sort);
   }
-  else if (Const const* value = dynamic_cast<Const const*>(v)) {
+  else if (Const const* value = value_cast<Const>(v)) {
     return v_const(value->name, value->sort);
   }
-  else if (Eq const* value = dynamic_cast<Eq const*>(v)) {
+  else if (Eq const* value = value_cast<Eq>(v)) {
     return v_eq(
         remove_unneeded_quants(value->left.get()),
         remove_unneeded_quants(value->right.get()));
   }
-  else if (Not const* value = dynamic_cast<Not const*>(v)) {
+  else if (Not const* value = value_cast<Not>(v)) {
     return v_not(remove_unneeded_quants(value->val.get()));
   }
-  else if (Implies const* value = dynamic_cast<Implies const*>(v)) {
+  else if (Implies const* value = value_cast<Implies>(v)) {
     return v_implies(
         remove_unneeded_quants(value->left.get()),
         remove_unneeded_quants(value->right.get()));
   }
-  else if (Apply const* value = dynamic_cast<Apply const*>(v)) {
+  else if (Apply const* value = value_cast<Apply>(v)) {
     vector<shared_ptr<Value>> args;
     for (auto a : value->args) {
       args.push_back(remove_unneeded_quants(a.get()));
     }
     return v_apply(value->func, args);
   }
-  else if (And const* value = dynamic_cast<And const*>(v)) {
+  else if (And const* value = value_cast<And>(v)) {
     vector<shared_ptr<Value>> args;
     for (auto a : value->args) {
       args.push_back(remove_unneeded_quants(a.get()));
     }
     return v_and(args);
   }
-  else if (Or const* value = dynamic_cast<Or const*>(v)) {
+  else if (Or const* value = value_cast<Or>(v)) {
     vector<shared_ptr<Value>> args;
     for (auto a : value->args) {
       args.push_back(remove_unneeded_quants(a.get()));
@@ -2173,7 +2549,7 @@ value factor_quants(value v) {
   value body = v;
   vector<VarDecl> decls;
   while (true) {
-    if (Forall* f = dynamic_cast<Forall*>(body.get())) {
+    if (Forall* f = value_cast<Forall>(body.get())) {
       extend(decls, f->decls);
       body = f->body;
     } else {
@@ -2184,7 +2560,7 @@ value factor_quants(value v) {
   if (decls.size() == 0) return v;
 
   vector<value> disj;
-  if (Or* o = dynamic_cast<Or*>(body.get())) {
+  if (Or* o = value_cast<Or>(body.get())) {
     disj = o->args;
   } else {
     return v;
@@ -2425,7 +2801,7 @@ void append_vector(vector<A>& a, vector<A> const& b) {
 vector<value> aggressively_split_into_conjuncts(value v)
 {
   assert(v.get() != NULL);
-  if (Forall* val = dynamic_cast<Forall*>(v.get())) {
+  if (Forall* val = value_cast<Forall>(v.get())) {
     vector<value> vs = aggressively_split_into_conjuncts(val->body);
     vector<value> res;
     for (int i = 0; i < (int)vs.size(); i++) {
@@ -2433,45 +2809,45 @@ vector<value> aggressively_split_into_conjuncts(value v)
     }
     return res;
   }
-  else if (dynamic_cast<Exists*>(v.get())) {
+  else if (value_cast<Exists>(v.get())) {
     return {v};
   }
-  else if (dynamic_cast<NearlyForall*>(v.get())) {
+  else if (value_cast<NearlyForall>(v.get())) {
     return {v};
   }
-  else if (dynamic_cast<Var*>(v.get())) {
+  else if (value_cast<Var>(v.get())) {
     return {v};
   }
-  else if (dynamic_cast<Const*>(v.get())) {
+  else if (value_cast<Const>(v.get())) {
     return {v};
   }
-  else if (dynamic_cast<Eq*>(v.get())) {
+  else if (value_cast<Eq>(v.get())) {
     return {v};
   }
-  else if (Not* val = dynamic_cast<Not*>(v.get())) {
+  else if (Not* val = value_cast<Not>(v.get())) {
     value w = val->val->negate();
     vector<value> res;
-    if (dynamic_cast<Not*>(w.get())) {
+    if (value_cast<Not>(w.get())) {
       res = {w};
     } else {
       res = aggressively_split_into_conjuncts(w);
     }
     return res;
   }
-  else if (Implies* val = dynamic_cast<Implies*>(v.get())) {
+  else if (Implies* val = value_cast<Implies>(v.get())) {
     return aggressively_split_into_conjuncts(v_or({v_not(val->left), val->right}));
   }
-  else if (dynamic_cast<Apply*>(v.get())) {
+  else if (value_cast<Apply>(v.get())) {
     return {v};
   }
-  else if (And* val = dynamic_cast<And*>(v.get())) {
+  else if (And* val = value_cast<And>(v.get())) {
     vector<value> res;
     for (value c : val->args) {
       append_vector(res, aggressively_split_into_conjuncts(c));
     }
     return res;
   }
-  else if (Or* val = dynamic_cast<Or*>(v.get())) {
+  else if (Or* val = value_cast<Or>(v.get())) {
     vector<vector<value>> a;
     vector<int> inds;
     for (value c : val->args) {
@@ -2509,7 +2885,7 @@ vector<value> aggressively_split_into_conjuncts(value v)
     }
     return res;
   }
-  else if (IfThenElse* val = dynamic_cast<IfThenElse*>(v.get())) {
+  else if (IfThenElse* val = value_cast<IfThenElse>(v.get())) {
     return concat_vector(
       aggressively_split_into_conjuncts(v_implies(val->cond, val->then_value)),
       aggressively_split_into_conjuncts(v_implies(v_not(val->cond), val->else_value))
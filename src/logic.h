@@ -1,11 +1,13 @@
 #ifndef LOGIC_H
 #define LOGIC_H
 
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <memory>
 #include <map>
 #include <set>
+#include <unordered_map>
 
 #include "lib/json11/json11.hpp"
 
@@ -80,8 +82,30 @@ public:
 
 struct ScopeState;
 
+// Tag for each Value subclass, so traversals can switch on v->kind or use
+// value_cast instead of dynamic_cast. The numbers are the order used by
+// cmp_expr.
+enum class ValueKind {
+  Forall = 1,
+  NearlyForall = 2,
+  Exists = 3,
+  Const = 4,
+  Not = 6,
+  Implies = 7,
+  Apply = 8,
+  And = 9,
+  Or = 10,
+  IfThenElse = 11,
+  TemplateHole = 12,
+  Var = 50,
+  Eq = 100
+};
+
 class Value {
 public:
+  ValueKind const kind;
+
+  explicit Value(ValueKind kind) : kind(kind) { }
   virtual ~Value() {}
 
   virtual std::string to_string() const = 0;
@@ -113,7 +137,7 @@ public:
   std::shared_ptr<Value> totally_normalize() const;
   std::shared_ptr<Value> reduce_quants() const;
 
-  virtual int kind_id() const = 0;
+  int kind_id() const { return (int)kind; }
 };
 
 class Forall : public Value {
@@ -124,7 +148,7 @@ public:
   Forall(
       std::vector<VarDecl> const& decls,
       std::shared_ptr<Value> body)
-      : decls(decls), body(body) { }
+      : Value(ValueKind::Forall), decls(decls), body(body) { }
 
   std::string to_string() const override;
   json11::Json to_json() const override;
@@ -144,7 +168,7 @@ public:
   std::shared_ptr<Value> order_and_or_eq(ScopeState const& ss) const override;
   void get_used_vars(std::set<iden>&) const override;
 
-  int kind_id() const override { return 1; }
+  static const ValueKind static_kind = ValueKind::Forall;
 };
 
 class NearlyForall : public Value {
@@ -155,7 +179,7 @@ public:
   NearlyForall(
       std::vector<VarDecl> const& decls,
       std::shared_ptr<Value> body)
-      : decls(decls), body(body) { }
+      : Value(ValueKind::NearlyForall), decls(decls), body(body) { }
 
   std::string to_string() const override;
   json11::Json to_json() const override;
@@ -175,7 +199,7 @@ public:
   std::shared_ptr<Value> order_and_or_eq(ScopeState const& ss) const override;
   void get_used_vars(std::set<iden>&) const override;
 
-  int kind_id() const override { return 2; }
+  static const ValueKind static_kind = ValueKind::NearlyForall;
 };
 
 class Exists : public Value {
@@ -186,7 +210,7 @@ public:
   Exists(
       std::vector<VarDecl> const& decls,
       std::shared_ptr<Value> body)
-      : decls(decls), body(body) { }
+      : Value(ValueKind::Exists), decls(decls), body(body) { }
 
   std::string to_string() const override;
   json11::Json to_json() const override;
@@ -206,7 +230,7 @@ public:
   std::shared_ptr<Value> order_and_or_eq(ScopeState const& ss) const override;
   void get_used_vars(std::set<iden>&) const override;
 
-  int kind_id() const override { return 3; }
+  static const ValueKind static_kind = ValueKind::Exists;
 };
 
 class Var : public Value {
@@ -217,7 +241,7 @@ public:
   Var(
       iden name,
       std::shared_ptr<Sort> sort)
-      : name(name), sort(sort) { }
+      : Value(ValueKind::Var), name(name), sort(sort) { }
 
   std::string to_string() const override;
   json11::Json to_json() const override;
@@ -237,7 +261,7 @@ public:
   std::shared_ptr<Value> order_and_or_eq(ScopeState const& ss) const override;
   void get_used_vars(std::set<iden>&) const override;
 
-  int kind_id() const override { return 50; }
+  static const ValueKind static_kind = ValueKind::Var;
 };
 
 class Const : public Value {
@@ -248,7 +272,7 @@ public:
   Const(
       iden name,
       std::shared_ptr<Sort> sort)
-      : name(name), sort(sort) { }
+      : Value(ValueKind::Const), name(name), sort(sort) { }
 
   std::string to_string() const override;
   json11::Json to_json() const override;
@@ -268,7 +292,7 @@ public:
   std::shared_ptr<Value> order_and_or_eq(ScopeState const& ss) const override;
   void get_used_vars(std::set<iden>&) const override;
 
-  int kind_id() const override { return 4; }
+  static const ValueKind static_kind = ValueKind::Const;
 };
 
 class Eq : public Value {
@@ -279,7 +303,7 @@ public:
   Eq(
     std::shared_ptr<Value> left,
     std::shared_ptr<Value> right)
-    : left(left), right(right) { }
+    : Value(ValueKind::Eq), left(left), right(right) { }
 
   std::string to_string() const override;
   json11::Json to_json() const override;
@@ -299,7 +323,7 @@ public:
   std::shared_ptr<Value> order_and_or_eq(ScopeState const& ss) const override;
   void get_used_vars(std::set<iden>&) const override;
 
-  int kind_id() const override { return 100; }
+  static const ValueKind static_kind = ValueKind::Eq;
 };
 
 class Not : public Value {
@@ -308,7 +332,7 @@ public:
 
   Not(
     std::shared_ptr<Value> val)
-    : val(val) { }
+    : Value(ValueKind::Not), val(val) { }
 
   std::string to_string() const override;
   json11::Json to_json() const override;
@@ -328,7 +352,7 @@ public:
   std::shared_ptr<Value> order_and_or_eq(ScopeState const& ss) const override;
   void get_used_vars(std::set<iden>&) const override;
 
-  int kind_id() const override { return 6; }
+  static const ValueKind static_kind = ValueKind::Not;
 };
 
 class Implies : public Value {
@@ -339,7 +363,7 @@ public:
   Implies(
     std::shared_ptr<Value> left,
     std::shared_ptr<Value> right)
-    : left(left), right(right) { }
+    : Value(ValueKind::Implies), left(left), right(right) { }
 
   std::string to_string() const override;
   json11::Json to_json() const override;
@@ -359,7 +383,7 @@ public:
   std::shared_ptr<Value> order_and_or_eq(ScopeState const& ss) const override;
   void get_used_vars(std::set<iden>&) const override;
 
-  int kind_id() const override { return 7; }
+  static const ValueKind static_kind = ValueKind::Implies;
 };
 
 class Apply : public Value {
@@ -370,7 +394,7 @@ public:
   Apply(
     std::shared_ptr<Value> func,
     std::vector<std::shared_ptr<Value>> const& args)
-    : func(func), args(args) { }
+    : Value(ValueKind::Apply), func(func), args(args) { }
 
   std::string to_string() const override;
   json11::Json to_json() const override;
@@ -390,7 +414,7 @@ public:
   std::shared_ptr<Value> order_and_or_eq(ScopeState const& ss) const override;
   void get_used_vars(std::set<iden>&) const override;
 
-  int kind_id() const override { return 8; }
+  static const ValueKind static_kind = ValueKind::Apply;
 };
 
 class And : public Value {
@@ -399,7 +423,7 @@ public:
 
   And(
     std::vector<std::shared_ptr<Value>> const& args)
-    : args(args) { }
+    : Value(ValueKind::And), args(args) { }
 
   std::string to_string() const override;
   json11::Json to_json() const override;
@@ -419,7 +443,7 @@ public:
   std::shared_ptr<Value> order_and_or_eq(ScopeState const& ss) const override;
   void get_used_vars(std::set<iden>&) const override;
 
-  int kind_id() const override { return 9; }
+  static const ValueKind static_kind = ValueKind::And;
 };
 
 class Or : public Value {
@@ -428,7 +452,7 @@ public:
 
   Or(
     std::vector<std::shared_ptr<Value>> const& args)
-    : args(args) { }
+    : Value(ValueKind::Or), args(args) { }
 
   std::string to_string() const override;
   json11::Json to_json() const override;
@@ -448,7 +472,7 @@ public:
   std::shared_ptr<Value> order_and_or_eq(ScopeState const& ss) const override;
   void get_used_vars(std::set<iden>&) const override;
 
-  int kind_id() const override { return 10; }
+  static const ValueKind static_kind = ValueKind::Or;
 };
 
 class IfThenElse : public Value {
@@ -461,7 +485,7 @@ public:
     std::shared_ptr<Value> cond,
     std::shared_ptr<Value> then_value,
     std::shared_ptr<Value> else_value)
-    : cond(cond), then_value(then_value), else_value(else_value) { }
+    : Value(ValueKind::IfThenElse), cond(cond), then_value(then_value), else_value(else_value) { }
 
   std::string to_string() const override;
   json11::Json to_json() const override;
@@ -481,12 +505,12 @@ public:
   std::shared_ptr<Value> order_and_or_eq(ScopeState const& ss) const override;
   void get_used_vars(std::set<iden>&) const override;
 
-  int kind_id() const override { return 11; }
+  static const ValueKind static_kind = ValueKind::IfThenElse;
 };
 
 class TemplateHole : public Value {
 public:
-  TemplateHole() { }
+  TemplateHole() : Value(ValueKind::TemplateHole) { }
   std::string to_string() const override;
   json11::Json to_json() const override;
   std::shared_ptr<Sort> get_sort() const override;
@@ -504,9 +528,21 @@ public:
   std::shared_ptr<Value> normalize_symmetries(ScopeState const& ss, std::set<iden> const& vars_used) const override;
   std::shared_ptr<Value> order_and_or_eq(ScopeState const& ss) const override;
   void get_used_vars(std::set<iden>&) const override;
-  int kind_id() const override { return 12; }
+  static const ValueKind static_kind = ValueKind::TemplateHole;
 };
 
+// Checked downcast by kind tag: like dynamic_cast<T*>, returns NULL if `v`
+// is NULL or not a T.
+template <typename T>
+inline T* value_cast(Value* v) {
+  return v != NULL && v->kind == T::static_kind ? static_cast<T*>(v) : NULL;
+}
+
+template <typename T>
+inline T const* value_cast(Value const* v) {
+  return v != NULL && v->kind == T::static_kind ? static_cast<T const*>(v) : NULL;
+}
+
 /* Action */
 
 class Action {
@@ -649,57 +685,137 @@ typedef std::shared_ptr<Sort> lsort;
 std::shared_ptr<Module> parse_module(std::string const& src);
 std::vector<value> parse_value_array(std::string const& src);
 
+// Bump allocator for short-lived values. While a ValueArena::Scope is
+// active on a thread, the v_* helpers allocate nodes (and their shared_ptr
+// control blocks) from it instead of the heap, and the arena is reset when
+// the scope ends. Any value that must outlive the scope has to be copied
+// out with promote() first.
+class ValueArena {
+public:
+  ValueArena() : block_idx(0), cur(NULL), left(0) { }
+  ValueArena(ValueArena const&) = delete;
+  ValueArena& operator=(ValueArena const&) = delete;
+
+  void* allocate(size_t n) {
+    n = (n + 15) & ~(size_t)15;
+    if (n > left) {
+      next_block(n);
+    }
+    void* p = cur;
+    cur += n;
+    left -= n;
+    return p;
+  }
+
+  // Invalidates everything allocated so far; keeps the blocks.
+  void reset();
+
+  bool owns(void const* p) const;
+
+  // Copies the arena-allocated nodes of `v` to the heap. Subterms that
+  // are already on the heap are shared, not copied.
+  value promote(value v) const;
+
+  class Scope {
+  public:
+    explicit Scope(ValueArena& arena);
+    ~Scope();
+  private:
+    ValueArena& arena;
+    ValueArena* prev;
+  };
+
+private:
+  std::vector<std::pair<std::unique_ptr<char[]>, size_t>> blocks;
+  int block_idx;
+  char* cur;
+  size_t left;
+
+  void next_block(size_t n);
+  value promote_rec(value v) const;
+  std::vector<value> promote_all(std::vector<value> const& vs) const;
+};
+
+extern thread_local ValueArena* current_value_arena;
+
+template <typename T>
+struct ValueArenaAllocator {
+  typedef T value_type;
+  ValueArena* arena;
+
+  explicit ValueArenaAllocator(ValueArena* arena) : arena(arena) { }
+  template <typename U>
+  ValueArenaAllocator(ValueArenaAllocator<U> const& other) : arena(other.arena) { }
+
+  T* allocate(size_t n) { return static_cast<T*>(arena->allocate(n * sizeof(T))); }
+  void deallocate(T*, size_t) { }
+
+  template <typename U>
+  bool operator==(ValueArenaAllocator<U> const& other) const { return arena == other.arena; }
+  template <typename U>
+  bool operator!=(ValueArenaAllocator<U> const& other) const { return arena != other.arena; }
+};
+
+template <typename T, typename... Args>
+inline value make_value(Args&&... args) {
+  if (current_value_arena != NULL) {
+    return std::allocate_shared<T>(ValueArenaAllocator<T>(current_value_arena),
+        std::forward<Args>(args)...);
+  }
+  return std::shared_ptr<Value>(new T(std::forward<Args>(args)...));
+}
+
 inline value v_forall(std::vector<VarDecl> const& decls, value const& body) {
-  return std::shared_ptr<Value>(new Forall(decls, body));
+  return make_value<Forall>(decls, body);
 }
 inline value v_nearlyforall(std::vector<VarDecl> const& decls, value const& body) {
-  return std::shared_ptr<Value>(new NearlyForall(decls, body));
+  return make_value<NearlyForall>(decls, body);
 }
 inline value v_exists(std::vector<VarDecl> const& decls, value const& body) {
-  return std::shared_ptr<Value>(new Exists(decls, body));
+  return make_value<Exists>(decls, body);
 }
 inline value v_var(iden name, lsort sort) {
-  return std::shared_ptr<Value>(new Var(name, sort));
+  return make_value<Var>(name, sort);
 }
 inline value v_const(iden name, lsort sort) {
-  return std::shared_ptr<Value>(new Const(name, sort));
+  return make_value<Const>(name, sort);
 }
 inline value v_eq(value a, value b) {
-  return std::shared_ptr<Value>(new Eq(a, b));
+  return make_value<Eq>(a, b);
 }
 inline value v_not(value a) {
-  if (Not* n = dynamic_cast<Not*>(a.get())) {
+  if (Not* n = value_cast<Not>(a.get())) {
     return n->val;
   } else {
-    return std::shared_ptr<Value>(new Not(a));
+    return make_value<Not>(a);
   }
 }
 inline value v_implies(value a, value b) {
-  return std::shared_ptr<Value>(new Implies(a, b));
+  return make_value<Implies>(a, b);
 }
 inline value v_apply(value func, std::vector<value> const& args) {
-  return std::shared_ptr<Value>(new Apply(func, args));
+  return make_value<Apply>(func, args);
 }
 inline value v_and(std::vector<value> const& args) {
   if (args.size() == 1) return args[0];
-  return std::shared_ptr<Value>(new And(args));
+  return make_value<And>(args);
 }
 inline value v_true() {
-  return std::shared_ptr<Value>(new And({}));
+  return make_value<And>(std::vector<value>());
 }
 inline value v_false() {
-  return std::shared_ptr<Value>(new Or({}));
+  return make_value<Or>(std::vector<value>());
 }
 inline value v_or(std::vector<value> const& args) {
   if (args.size() == 1) return args[0];
-  return std::shared_ptr<Value>(new Or(args));
+  return make_value<Or>(args);
 }
 inline value v_if_then_else(value cond, value then_value, value else_value)
 {
-  return std::shared_ptr<Value>(new IfThenElse(cond, then_value, else_value));
+  return make_value<IfThenElse>(cond, then_value, else_value);
 }
 inline value v_template_hole() {
-  return std::shared_ptr<Value>(new TemplateHole());
+  return make_value<TemplateHole>();
 }
 
 inline lsort s_bool() {
@@ -724,6 +840,87 @@ struct ComparableValue {
   }
 };
 
+// Hash-consing table for values. Values that are equal under cmp_expr
+// (bound variables compared by position, free ones by name) get the same
+// small integer id, so sets and maps of formulas can be keyed by id and
+// compared in O(1) instead of walking both formulas. Each subterm is
+// interned too, keyed by its kind, payload and children's ids, so the hash
+// of a node is computed once from already-interned parts.
+// Not thread-safe; use one per solver.
+class ValueInterner {
+public:
+  // Interns `v` if no equal value has been seen, and returns its id.
+  int intern(value v) { return get_id(v, {}, true); }
+
+  // Returns the id of a value equal to `v`, or -1 if there is none.
+  // Does not grow the table.
+  int find(value v) { return get_id(v, {}, false); }
+
+  // Interns `v` and returns whether it was new.
+  bool insert(value v) {
+    int n = size();
+    return intern(v) >= n;
+  }
+
+  // The first value interned with this id
+  value get(int id) const { return nodes[id]; }
+
+  int size() const { return nodes.size(); }
+
+private:
+  struct KeyHash {
+    size_t operator()(std::vector<int> const& key) const;
+  };
+
+  std::unordered_map<std::vector<int>, int, KeyHash> table;
+  std::vector<value> nodes;
+  std::map<std::string, int> sort_ids;
+
+  int sort_id(lsort s);
+  int get_id(value v, std::vector<VarDecl> const& scope, bool insert);
+};
+
+// 64-bit hash of `v` that agrees with values_equal: bound variables are
+// hashed by scope position, so alpha-equivalent values collide.
+uint64_t value_fingerprint(value v);
+
+// Open-addressing table from fingerprints to ids. A fingerprint may carry
+// several ids; callers confirm a hit with a full comparison.
+class FingerprintSet {
+public:
+  FingerprintSet() : slots(16), count(0) { }
+
+  void insert(uint64_t fp, int id);
+
+  // Whether any id was inserted under `fp`.
+  bool contains(uint64_t fp) const;
+
+  // Calls `f(id)` for each id under `fp` until one returns true.
+  template <typename F>
+  bool find_if(uint64_t fp, F const& f) const {
+    size_t mask = slots.size() - 1;
+    for (size_t i = fp & mask; slots[i].id != -1; i = (i + 1) & mask) {
+      if (slots[i].fp == fp && f(slots[i].id)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  int size() const { return count; }
+
+private:
+  struct Slot {
+    uint64_t fp = 0;
+    int id = -1;
+  };
+
+  std::vector<Slot> slots;
+  int count;
+
+  void grow();
+};
+
 VarDecl freshVarDecl(lsort sort);
 
 std::vector<value> aggressively_split_into_conjuncts(value);
@@ -12,6 +12,7 @@
 #include "template_priority.h"
 #include "z3++.h"
 #include "stats.h"
+#include "bitset_kernels.h"
 
 #include <iostream>
 #include <iterator>
@@ -44,10 +45,10 @@ bool is_redundant(
 }
 
 value augment_invariant(value a, value b) {
-  if (Forall* f = dynamic_cast<Forall*>(a.get())) {
+  if (Forall* f = value_cast<Forall>(a.get())) {
     return v_forall(f->decls, augment_invariant(f->body, b));
   }
-  else if (Or* o = dynamic_cast<Or*>(a.get())) {
+  else if (Or* o = value_cast<Or>(a.get())) {
     vector<value> args = o->args;
     args.push_back(b);
     return v_or(args);
@@ -106,6 +107,11 @@ void print_wpr(shared_ptr<Module> module, int count)
 
 int run_id;
 extern bool enable_smt_logging;
+extern bool pad_bitset_blocks;
+extern bool bitset_subsumption_index;
+extern bool incremental_model_min;
+extern int smt_portfolio_size;
+extern std::string smt_cache_dir;
 
 struct EnumOptions {
   int template_idx;
@@ -588,7 +594,9 @@ int main(int argc, char* argv[]) {
   options.get_space_size = false;
   options.minimal_models = false;
   options.non_accumulative = false;
-  //options.threads = 1;
+  options.concurrent_checks = false;
+  options.threads = 1;
+  options.batch_size = 1;
 
   string output_chunk_dir;
   string input_chunk_file;
@@ -687,6 +695,12 @@ int main(int argc, char* argv[]) {
     else if (argv[i] == string("--log-smt-files")) {
       enable_smt_logging = true;
     }
+    else if (argv[i] == string("--pad-bitset-blocks")) {
+      pad_bitset_blocks = true;
+    }
+    else if (argv[i] == string("--bitset-subsumption-index")) {
+      bitset_subsumption_index = true;
+    }
     else if (argv[i] == string("--pre-bmc")) {
       options.pre_bmc = true;
     }
@@ -702,6 +716,13 @@ int main(int argc, char* argv[]) {
     else if (argv[i] == string("--minimal-models")) {
       options.minimal_models = true;
     }
+    else if (argv[i] == string("--incremental-minimal-models")) {
+      incremental_model_min = true;
+    }
+    else if (argv[i] == string("--concurrent-checks")) {
+      // overlaps only the incremental inductiveness checks
+      options.concurrent_checks = true;
+    }
     else if (argv[i] == string("--output-chunk-dir")) {
       assert(i + 1 < argc);
       assert (output_chunk_dir == "");
@@ -714,6 +735,23 @@ int main(int argc, char* argv[]) {
       nthreads = atoi(argv[i+1]);
       i++;
     }
+    else if (argv[i] == string("--smt-cache-dir")) {
+      assert(i + 1 < argc);
+      smt_cache_dir = argv[i+1];
+      i++;
+    }
+    else if (argv[i] == string("--smt-portfolio")) {
+      assert(i + 1 < argc);
+      smt_portfolio_size = atoi(argv[i+1]);
+      assert(smt_portfolio_size >= 1);
+      i++;
+    }
+    else if (argv[i] == string("--batch-size")) {
+      assert(i + 1 < argc);
+      options.batch_size = atoi(argv[i+1]);
+      assert(options.batch_size >= 1);
+      i++;
+    }
     else if (argv[i] == string("--input-module")) {
       assert(i + 1 < argc);
       assert(module_filename == "");
@@ -771,6 +809,12 @@ int main(int argc, char* argv[]) {
       options.invariant_log_filename = argv[i+1];
       i++;
     }
+    else if (argv[i] == string("--shared-cex-log")) {
+      assert(i + 1 < argc);
+      assert(options.shared_cex_log_filename == "");
+      options.shared_cex_log_filename = argv[i+1];
+      i++;
+    }
     else if (argv[i] == string("--counts-only")) {
       counts_only = true;
     }
@@ -991,6 +1035,7 @@ int main(int argc, char* argv[]) {
   }
 
   printf("random seed = %d\n", seed);
+  printf("bitset kernels = %s\n", bitset_kernels.name);
   srand(seed);
 
   FormulaDump input_fd;
@@ -1060,13 +1105,25 @@ int main(int argc, char* argv[]) {
           assert (false);
         }
       }
-      assert (false); // TODO not implemented because the size of the return vector isn't guaranteed
-      //assert (!by_size);
-      //sub_slices_breadth = prioritize_sub_slices(module, slices_breadth, 1, true)[0];
-      //sub_slices_finisher = prioritize_sub_slices(module, slices_finisher, 1, false)[0];
+      // Everything runs in this process, so take all the chunks made for
+      // a single thread, in order.
+      for (auto const& group : prioritize_sub_slices(module, slices_breadth, 1, true, by_size, true)) {
+        for (auto const& chunk : group) {
+          vector_append(sub_slices_breadth, chunk);
+        }
+      }
+      for (auto const& group : prioritize_sub_slices(module, slices_finisher, 1, false, by_size, true)) {
+        for (auto const& chunk : group) {
+          vector_append(sub_slices_finisher, chunk);
+        }
+      }
     }
   }
 
+  if (nthreads != -1) {
+    options.threads = nthreads;
+  }
+
   FormulaDump output_fd;
   output_fd.success = false;
   output_fd.base_invs = input_fd.base_invs;
@@ -1079,7 +1136,7 @@ int main(int argc, char* argv[]) {
     long long f_post_symm = -1;
     if (sub_slices_breadth.size() > 0) {
       shared_ptr<CandidateSolver> cs =
-          make_candidate_solver(module, sub_slices_breadth, true);
+          make_candidate_solver(module, sub_slices_breadth, true, 1, 1);
       b_pre_symm = cs->getPreSymmCount();
       cout << "b_pre_symm " << b_pre_symm << endl;
       b_post_symm = cs->getSpaceSize();
@@ -1087,7 +1144,7 @@ int main(int argc, char* argv[]) {
     }
     if (sub_slices_finisher.size() > 0) {
       shared_ptr<CandidateSolver> cs = make_candidate_solver(
-          module, sub_slices_finisher, false);
+          module, sub_slices_finisher, false, 1, 1);
       f_pre_symm = cs->getPreSymmCount();
       cout << "f_pre_symm " << f_pre_symm << endl;
       f_post_symm = cs->getSpaceSize();
@@ -1,6 +1,7 @@
 #include "model.h"
 
 #include <cassert>
+#include <cstring>
 #include <map>
 #include <algorithm>
 
@@ -10,6 +11,9 @@
 using namespace std;
 using namespace json11;
 
+bool pad_bitset_blocks = false;
+bool incremental_model_min = false;
+
 enum class EvalExprType {
   Forall,
   Exists,
@@ -45,17 +49,17 @@ EvalExpr Model::value_to_eval_expr(
 
   EvalExpr ee;
 
-  if (dynamic_cast<Forall*>(v.get()) || dynamic_cast<Exists*>(v.get()) || dynamic_cast<NearlyForall*>(v.get())) {
+  if (value_cast<Forall>(v.get()) || value_cast<Exists>(v.get()) || value_cast<NearlyForall>(v.get())) {
     std::vector<VarDecl> const * decls;
     std::shared_ptr<Value> body;
 
-    if (Forall* value = dynamic_cast<Forall*>(v.get())) {
+    if (Forall* value = value_cast<Forall>(v.get())) {
       decls = &value->decls;
       body = value->body;
-    } else if (Exists* value = dynamic_cast<Exists*>(v.get())) {
+    } else if (Exists* value = value_cast<Exists>(v.get())) {
       decls = &value->decls;
       body = value->body;
-    } else if (NearlyForall* value = dynamic_cast<NearlyForall*>(v.get())) {
+    } else if (NearlyForall* value = value_cast<NearlyForall>(v.get())) {
       decls = &value->decls;
       body = value->body;
     } else {
@@ -69,7 +73,7 @@ EvalExpr Model::value_to_eval_expr(
 
     ee = value_to_eval_expr(body, new_names); 
 
-    if (dynamic_cast<NearlyForall*>(v.get())) {
+    if (value_cast<NearlyForall>(v.get())) {
       EvalExpr ee2;
       ee2.type = EvalExprType::NearlyForall;
       for (int i = 0; i < (int)decls->size(); i++) {
@@ -83,7 +87,7 @@ EvalExpr Model::value_to_eval_expr(
       for (int i = decls->size() - 1; i >= 0; i--) {
         VarDecl decl = (*decls)[i];
         EvalExpr ee2;
-        ee2.type = dynamic_cast<Forall*>(v.get()) ? EvalExprType::Forall : EvalExprType::Exists;
+        ee2.type = value_cast<Forall>(v.get()) ? EvalExprType::Forall : EvalExprType::Exists;
         ee2.quantifier_domain_size = get_domain_size(decl.sort.get());
         ee2.var_index = names.size() + i;
         ee2.args.push_back(move(ee));
@@ -91,7 +95,7 @@ EvalExpr Model::value_to_eval_expr(
       }
     }
   }
-  else if (Var* value = dynamic_cast<Var*>(v.get())) {
+  else if (Var* value = value_cast<Var>(v.get())) {
     int idx = -1;
     for (int i = 0; i < (int)names.size(); i++) {
       if (names[i] == value->name) {
@@ -106,35 +110,34 @@ EvalExpr Model::value_to_eval_expr(
     ee.type = EvalExprType::Var;
     ee.var_index = idx;
   }
-  else if (Const* value = dynamic_cast<Const*>(v.get())) {
+  else if (Const* value = value_cast<Const>(v.get())) {
     auto iter = function_info.find(value->name);
     if (iter == function_info.end()) {
       cout << "could not find " << iden_to_string(value->name) << endl;
       assert(false);
     }
     FunctionInfo const& finfo = iter->second;
-    FunctionTable* ftable = finfo.table.get();
-    int val = ftable == NULL ? finfo.else_value : ftable->value;
+    int val = finfo.dense[0];
 
     ee.type = EvalExprType::Const;
     ee.const_value = val;
   }
-  else if (Eq* value = dynamic_cast<Eq*>(v.get())) {
+  else if (Eq* value = value_cast<Eq>(v.get())) {
     ee.type = EvalExprType::Eq;
     ee.args.push_back(value_to_eval_expr(value->left, names));
     ee.args.push_back(value_to_eval_expr(value->right, names));
   }
-  else if (Not* value = dynamic_cast<Not*>(v.get())) {
+  else if (Not* value = value_cast<Not>(v.get())) {
     ee.type = EvalExprType::Not;
     ee.args.push_back(value_to_eval_expr(value->val, names));
   }
-  else if (Implies* value = dynamic_cast<Implies*>(v.get())) {
+  else if (Implies* value = value_cast<Implies>(v.get())) {
     ee.type = EvalExprType::Implies;
     ee.args.push_back(value_to_eval_expr(value->left, names));
     ee.args.push_back(value_to_eval_expr(value->right, names));
   }
-  else if (Apply* value = dynamic_cast<Apply*>(v.get())) {
-    Const* func = dynamic_cast<Const*>(value->func.get());
+  else if (Apply* value = value_cast<Apply>(v.get())) {
+    Const* func = value_cast<Const>(value->func.get());
     auto iter = function_info.find(func->name);
     if (iter == function_info.end()) {
       printf("could not find function name %s\n", iden_to_string(func->name).c_str());
@@ -149,19 +152,19 @@ EvalExpr Model::value_to_eval_expr(
       ee.args.push_back(value_to_eval_expr(arg, names));
     }
   }
-  else if (And* value = dynamic_cast<And*>(v.get())) {
+  else if (And* value = value_cast<And>(v.get())) {
     ee.type = EvalExprType::And;
     for (auto arg : value->args) {
       ee.args.push_back(value_to_eval_expr(arg, names));
     }
   }
-  else if (Or* value = dynamic_cast<Or*>(v.get())) {
+  else if (Or* value = value_cast<Or>(v.get())) {
     ee.type = EvalExprType::Or;
     for (auto arg : value->args) {
       ee.args.push_back(value_to_eval_expr(arg, names));
     }
   }
-  else if (IfThenElse* value = dynamic_cast<IfThenElse*>(v.get())) {
+  else if (IfThenElse* value = value_cast<IfThenElse>(v.get())) {
     ee.type = EvalExprType::IfThenElse;
     ee.args.push_back(value_to_eval_expr(value->cond, names));
     ee.args.push_back(value_to_eval_expr(value->then_value, names));
@@ -174,9 +177,9 @@ EvalExpr Model::value_to_eval_expr(
   return ee;
 }
 
-int max_var(EvalExpr& ee) {
+int max_var(EvalExpr const& ee) {
   int res = -1;
-  for (EvalExpr& child : ee.args) {
+  for (EvalExpr const& child : ee.args) {
     res = max(res, max_var(child));
   }
   if (ee.type == EvalExprType::Forall || ee.type == EvalExprType::Exists) {
@@ -270,15 +273,12 @@ object_value eval(EvalExpr const& ee, int* var_values) {
       return (int)(!eval(ee.args[0], var_values) || (bool)eval(ee.args[1], var_values));
 
     case EvalExprType::Apply: {
-      FunctionTable* ftable = ee.function_info->table.get();
-      for (EvalExpr const& arg : ee.args) {
-        if (ftable == NULL) {
-          break;
-        }
-        object_value arg_res = eval(arg, var_values);
-        ftable = ftable->children[arg_res].get();
+      FunctionInfo const& finfo = *ee.function_info;
+      size_t idx = 0;
+      for (int i = 0; i < (int)ee.args.size(); i++) {
+        idx += (size_t)eval(ee.args[i], var_values) * finfo.strides[i];
       }
-      return ftable == NULL ? ee.function_info->else_value : ftable->value;
+      return finfo.dense[idx];
     }
 
     case EvalExprType::And:
@@ -306,6 +306,238 @@ object_value eval(EvalExpr const& ee, int* var_values) {
   }
 }
 
+// Flat, register-based form of an EvalExpr, for the hot loops that evaluate
+// the same quantifier-free body at every assignment. Registers start with
+// the variables (so the caller writes assignments straight into them),
+// then constants, then temporaries. Apply indexes the function's dense
+// table directly. Quantified subterms are rare here and are left to
+// the tree walker.
+
+enum class EvalOp : uint8_t {
+  Move,
+  Eq,
+  Not,
+  Apply,
+  Tree,
+  Jump,
+  JumpIfZero,
+  JumpIfNonZero
+};
+
+struct EvalInstr {
+  EvalOp op;
+  int dst;
+  int a;
+  int b;
+};
+
+struct EvalProgram {
+  vector<EvalInstr> code;
+  vector<FunctionInfo const*> functions;
+  vector<int> arg_regs;
+  vector<EvalExpr const*> trees;
+  vector<object_value> init_regs;
+  int n_vars;
+  int result;
+
+  static EvalProgram compile(EvalExpr const& ee, int n_vars);
+
+  object_value run(object_value* regs) const;
+
+private:
+  map<FunctionInfo const*, int> function_index;
+  map<object_value, int> const_regs;
+
+  int new_reg() {
+    init_regs.push_back(0);
+    return init_regs.size() - 1;
+  }
+  int emit(EvalOp op, int dst, int a, int b) {
+    code.push_back(EvalInstr{op, dst, a, b});
+    return code.size() - 1;
+  }
+  void patch(int pc) { code[pc].b = code.size(); }
+
+  int get_function(FunctionInfo const* finfo);
+  int const_reg(object_value v);
+  int compile_reg(EvalExpr const& ee);
+  void compile_into(EvalExpr const& ee, int dst);
+};
+
+int EvalProgram::get_function(FunctionInfo const* finfo)
+{
+  auto iter = function_index.find(finfo);
+  if (iter != function_index.end()) {
+    return iter->second;
+  }
+
+  functions.push_back(finfo);
+  function_index.insert(make_pair(finfo, (int)functions.size() - 1));
+  return functions.size() - 1;
+}
+
+int EvalProgram::const_reg(object_value v)
+{
+  auto iter = const_regs.find(v);
+  if (iter != const_regs.end()) {
+    return iter->second;
+  }
+  int r = new_reg();
+  init_regs[r] = v;
+  const_regs.insert(make_pair(v, r));
+  return r;
+}
+
+int EvalProgram::compile_reg(EvalExpr const& ee)
+{
+  if (ee.type == EvalExprType::Var) {
+    assert(ee.var_index < n_vars);
+    return ee.var_index;
+  }
+  if (ee.type == EvalExprType::Const) {
+    return const_reg(ee.const_value);
+  }
+  int r = new_reg();
+  compile_into(ee, r);
+  return r;
+}
+
+void EvalProgram::compile_into(EvalExpr const& ee, int dst)
+{
+  switch (ee.type) {
+    case EvalExprType::Forall:
+    case EvalExprType::Exists:
+    case EvalExprType::NearlyForall:
+      trees.push_back(&ee);
+      emit(EvalOp::Tree, dst, trees.size() - 1, 0);
+      break;
+
+    case EvalExprType::Var:
+    case EvalExprType::Const:
+      emit(EvalOp::Move, dst, compile_reg(ee), 0);
+      break;
+
+    case EvalExprType::Eq: {
+      int a = compile_reg(ee.args[0]);
+      int b = compile_reg(ee.args[1]);
+      emit(EvalOp::Eq, dst, a, b);
+      break;
+    }
+
+    case EvalExprType::Not:
+      emit(EvalOp::Not, dst, compile_reg(ee.args[0]), 0);
+      break;
+
+    case EvalExprType::Implies: {
+      compile_into(ee.args[0], dst);
+      emit(EvalOp::Not, dst, dst, 0);
+      int j = emit(EvalOp::JumpIfNonZero, 0, dst, 0);
+      compile_into(ee.args[1], dst);
+      patch(j);
+      break;
+    }
+
+    case EvalExprType::Apply: {
+      int f = get_function(ee.function_info);
+      int n = functions[f]->strides.size();
+      vector<int> regs;
+      for (int i = 0; i < n; i++) {
+        regs.push_back(compile_reg(ee.args[i]));
+      }
+      int start = arg_regs.size();
+      for (int r : regs) {
+        arg_regs.push_back(r);
+      }
+      emit(EvalOp::Apply, dst, f, start);
+      break;
+    }
+
+    case EvalExprType::And:
+    case EvalExprType::Or: {
+      if (ee.args.size() == 0) {
+        emit(EvalOp::Move, dst, const_reg(ee.type == EvalExprType::And ? 1 : 0), 0);
+        break;
+      }
+      EvalOp jump = ee.type == EvalExprType::And ? EvalOp::JumpIfZero : EvalOp::JumpIfNonZero;
+      vector<int> jumps;
+      for (int i = 0; i < (int)ee.args.size(); i++) {
+        compile_into(ee.args[i], dst);
+        if (i + 1 < (int)ee.args.size()) {
+          jumps.push_back(emit(jump, 0, dst, 0));
+        }
+      }
+      for (int j : jumps) {
+        patch(j);
+      }
+      break;
+    }
+
+    case EvalExprType::IfThenElse: {
+      int c = compile_reg(ee.args[0]);
+      int j1 = emit(EvalOp::JumpIfZero, 0, c, 0);
+      compile_into(ee.args[1], dst);
+      int j2 = emit(EvalOp::Jump, 0, 0, 0);
+      patch(j1);
+      compile_into(ee.args[2], dst);
+      patch(j2);
+      break;
+    }
+  }
+}
+
+EvalProgram EvalProgram::compile(EvalExpr const& ee, int n_vars)
+{
+  EvalProgram prog;
+  prog.n_vars = n_vars;
+  prog.init_regs.resize(n_vars);
+  prog.result = prog.compile_reg(ee);
+  return prog;
+}
+
+object_value EvalProgram::run(object_value* regs) const
+{
+  EvalInstr const* pc = code.data();
+  EvalInstr const* end = pc + code.size();
+  while (pc != end) {
+    EvalInstr const& in = *pc;
+    pc++;
+    switch (in.op) {
+      case EvalOp::Move:
+        regs[in.dst] = regs[in.a];
+        break;
+      case EvalOp::Eq:
+        regs[in.dst] = regs[in.a] == regs[in.b];
+        break;
+      case EvalOp::Not:
+        regs[in.dst] = 1 - regs[in.a];
+        break;
+      case EvalOp::Apply: {
+        FunctionInfo const& f = *functions[in.a];
+        int const* args = &arg_regs[in.b];
+        size_t idx = 0;
+        for (int i = 0; i < (int)f.strides.size(); i++) {
+          idx += (size_t)regs[args[i]] * f.strides[i];
+        }
+        regs[in.dst] = f.dense[idx];
+        break;
+      }
+      case EvalOp::Tree:
+        regs[in.dst] = eval(*trees[in.a], (int*)regs);
+        break;
+      case EvalOp::Jump:
+        pc = code.data() + in.b;
+        break;
+      case EvalOp::JumpIfZero:
+        if (!regs[in.a]) pc = code.data() + in.b;
+        break;
+      case EvalOp::JumpIfNonZero:
+        if (regs[in.a]) pc = code.data() + in.b;
+        break;
+    }
+  }
+  return regs[result];
+}
+
 bool Model::eval_predicate(shared_ptr<Value> value) const {
   EvalExpr ee = value_to_eval_expr(value, {});
 
@@ -355,7 +587,7 @@ QuantifierInstantiation get_counterexample(shared_ptr<Model> model, value v) {
   value w = v;
   int idx = 0;
   for (int i = 0; i < n; i++) {
-    Forall* f = dynamic_cast<Forall*>(w.get());
+    Forall* f = value_cast<Forall>(w.get());
     assert(f != NULL);
     qi.decls.push_back(f->decls[idx]);
     idx++;
@@ -497,12 +729,12 @@ bool get_multiqi_counterexample(shared_ptr<Model> model, value v,
   for (int i = 0; i < n; i++) {
     int sz;
     value bd;
-    if (Forall* f = dynamic_cast<Forall*>(w.get())) {
+    if (Forall* f = value_cast<Forall>(w.get())) {
       qi.decls.push_back(f->decls[idx]);
       sz = f->decls.size();
       bd = f->body;
     }
-    else if (NearlyForall* f = dynamic_cast<NearlyForall*>(w.get())) {
+    else if (NearlyForall* f = value_cast<NearlyForall>(w.get())) {
       qi.decls.push_back(f->decls[idx]);
       sz = f->decls.size();
       bd = f->body;
@@ -606,6 +838,54 @@ vector<shared_ptr<Model>> Model::extract_minimal_models_from_z3(
     try_hint_sizes = true;
   }
 
+  // With incremental_model_min, each sort gets constants for the elements
+  // of the first model up front, along with literals collapse[i][j-1] that
+  // force the j-th one to equal the first. Trying a size is then a check
+  // that assumes some of these literals, with nothing asserted, and the
+  // models are extracted once at the end rather than after every sat; a sat
+  // check only reads the domain sizes.
+  vector<int> initial_sizes = sizes;
+  vector<smt::sort> sort_exprs;
+  for (string const& so : sorts) {
+    sort_exprs.push_back(bgctx.getUninterpretedSort(so));
+  }
+  vector<vector<smt::expr>> collapse(sorts.size());
+  int num_probes = 0;
+  bool last_sat = false;
+  if (incremental_model_min) {
+    solver.push();
+    for (int i = 0; i < (int)sorts.size(); i++) {
+      smt::sort so = bgctx.getUninterpretedSort(sorts[i]);
+      vector<smt::expr> cs;
+      smt::expr_vector vec(ctx);
+      smt::expr elem = ctx.bound_var(name("valvar").c_str(), so);
+      for (int j = 0; j < sizes[i]; j++) {
+        cs.push_back(ctx.var(name("val").c_str(), so));
+        vec.push_back(elem == cs[j]);
+      }
+      smt::expr_vector qvars(ctx);
+      qvars.push_back(elem);
+      solver.add(smt::forall(qvars, mk_or(vec)));
+
+      for (int j = 1; j < sizes[i]; j++) {
+        smt::expr lit = ctx.var(name("collapse").c_str(), ctx.bool_sort());
+        solver.add(smt::implies(lit, cs[j] == cs[0]));
+        collapse[i].push_back(lit);
+      }
+    }
+  }
+
+  // The literals that limit each sort to `new_sizes`
+  auto size_assumptions = [&](vector<int> const& new_sizes) {
+    smt::expr_vector assumptions(ctx);
+    for (int i = 0; i < (int)sorts.size(); i++) {
+      for (int j = new_sizes[i]; j < initial_sizes[i]; j++) {
+        assumptions.push_back(collapse[i][j - 1]);
+      }
+    }
+    return assumptions;
+  };
+
   int sort_idx = 0;
   int lower_bound_size = 0;
   while (sort_idx < (int)sorts.size()) {
@@ -638,6 +918,29 @@ vector<shared_ptr<Model>> Model::extract_minimal_models_from_z3(
 
     cout << "trying sizes: "; for (int k : new_sizes) cout << k << " "; cout << endl; cout.flush();
 
+    if (incremental_model_min) {
+      solver.set_log_info("extract minimal");
+      smt::SolverResult res = solver.check_result(size_assumptions(new_sizes));
+      num_probes++;
+      last_sat = (res == smt::SolverResult::Sat);
+
+      if (res == smt::SolverResult::Sat) {
+        sizes = z3_domain_sizes(ctx, solver, sort_exprs);
+        for (int j = 0; j < (int)sorts.size(); j++) {
+          assert (sizes[j] <= new_sizes[j]);
+        }
+        cout << "got sizes: "; for (int k : sizes) cout << k << " "; cout << endl; cout.flush();
+        try_hint_sizes = false;
+      } else if (try_hint_sizes) {
+        try_hint_sizes = false;
+      } else if (res == smt::SolverResult::Unknown) {
+        lower_bound_size = sizes[sort_idx] - 1;
+      } else {
+        lower_bound_size = new_sizes[sort_idx];
+      }
+      continue;
+    }
+
     solver.push();
 
     for (int i = 0; i < (int)sorts.size(); i++) {
@@ -689,6 +992,24 @@ vector<shared_ptr<Model>> Model::extract_minimal_models_from_z3(
     solver.pop();
   }
 
+  if (incremental_model_min && num_probes > 0) {
+    if (!last_sat) {
+      solver.set_log_info("extract minimal");
+      last_sat = (solver.check_result(size_assumptions(sizes))
+          == smt::SolverResult::Sat);
+    }
+    // Otherwise, keep the models of the first check.
+    if (last_sat) {
+      all_models.clear();
+      for (auto e : es) {
+        all_models.push_back(extract_model_from_z3(ctx, solver, module, *e));
+      }
+    }
+  }
+  if (incremental_model_min) {
+    solver.pop();
+  }
+
   return all_models;
 }
 
@@ -924,15 +1245,7 @@ void Model::assert_model_is_or_isnt(shared_ptr<ModelEmbedding> e,
       args.push_back(0);
     }
     while (true) {
-      object_value res = finfo.else_value;
-      FunctionTable* ftable = finfo.table.get();
-      for (int i = 0; i < (int)num_args; i++) {
-        if (ftable == NULL) break;
-        ftable = ftable->children[args[i]].get();
-      }
-      if (ftable != NULL) {
-        res = ftable->value;
-      }
+      object_value res = finfo.lookup(args.data());
 
       smt::expr_vector z3_args(bgctx.ctx);
       for (int i = 0; i < (int)domain_sorts.size(); i++) {
@@ -1120,7 +1433,7 @@ Z3VarSet add_existential_constraint(
   smt::solver& solver = bgctx->solver;
 
   // Change NOT(forall ...) into a (exists ...)
-  if (Not* n = dynamic_cast<Not*>(v.get())) {
+  if (Not* n = value_cast<Not>(v.get())) {
     v = n->val->negate();
   }
 
@@ -1128,7 +1441,7 @@ Z3VarSet add_existential_constraint(
   unordered_map<iden, smt::expr> vars;
 
   Exists* exists;
-  while ((exists = dynamic_cast<Exists*>(v.get())) != NULL) {
+  while ((exists = value_cast<Exists>(v.get())) != NULL) {
     for (VarDecl decl : exists->decls) {
       smt::func_decl fd = ctx.function(name(decl.name).c_str(), 0, 0, bgctx->getSort(decl.sort));
       smt::expr e = fd();
@@ -1180,39 +1493,23 @@ bool eval_qi(QuantifierInstantiation const& qi, value v)
   return ans == 1;
 }
 
-BitsetEvalResult BitsetEvalResult::eval_over_foralls(shared_ptr<Model> model, value val)
+// Packs one bit per assignment of `sizes` (given fastest-varying digit
+// first) into `ber`. step(k) is called after digit k has been incremented
+// and every faster digit has wrapped to 0. A new word is started whenever
+// a digit at or above pad_from changes.
+template <typename Bit, typename Step>
+static void pack_assignment_bits(vector<int> const& sizes, int pad_from,
+    BitsetEvalResult& ber, Bit bit, Step step)
 {
-  //model->dump();
-  //cout << "eval'ing for value: " << val->to_string() << endl;
-
-  auto p = get_tqd_and_body(val);
-  TopQuantifierDesc const& tqd = p.first;
-  value bodyval = p.second;
-  vector<VarDecl> decls = tqd.decls();
-  vector<iden> names;
-  for (VarDecl const& decl : decls) {
-    names.push_back(decl.name);
-  }
-  EvalExpr ee = model->value_to_eval_expr(bodyval, names);
-
-  int n_vars = max(max_var(ee), (int)decls.size()) + 1;
-  int* var_values = new int[n_vars];
-
-  BitsetEvalResult ber;
-  vector<int> max_sizes;
-  max_sizes.resize(decls.size());
-  for (int i = 0; i < (int)decls.size(); i++) {
-    max_sizes[i] = model->get_domain_size(decls[i].sort);
-    var_values[i] = 0;
-  }
+  int n = sizes.size();
+  vector<int> digits(n, 0);
 
   uint64_t cur = 0;
   int bit_place = 0;
   while (true) {
-    //cout << "bp: " << bit_place << endl;
-    int ans = eval(ee, var_values);
+    uint64_t ans = bit();
     assert(ans == 0 || ans == 1);
-    cur |= ((uint64_t)ans << bit_place);
+    cur |= (ans << bit_place);
     bit_place++;
     if (bit_place == 64) {
       ber.v.push_back(cur);
@@ -1220,18 +1517,24 @@ BitsetEvalResult BitsetEvalResult::eval_over_foralls(shared_ptr<Model> model, va
       bit_place = 0;
     }
 
-    int i;
-    for (i = 0; i < (int)decls.size(); i++) {
-      var_values[i]++;
-      if (var_values[i] == max_sizes[i]) {
-        var_values[i] = 0;
+    int k;
+    for (k = 0; k < n; k++) {
+      digits[k]++;
+      if (digits[k] == sizes[k]) {
+        digits[k] = 0;
       } else {
         break;
       }
     }
-    if (i == (int)decls.size()) {
+    if (k == n) {
       break;
     }
+    step(k);
+    if (k >= pad_from && bit_place > 0) {
+      ber.v.push_back(cur);
+      cur = 0;
+      bit_place = 0;
+    }
   }
 
   if (bit_place > 0) {
@@ -1240,8 +1543,304 @@ BitsetEvalResult BitsetEvalResult::eval_over_foralls(shared_ptr<Model> model, va
   } else {
     ber.last_bits = (uint64_t)(-1);
   }
+}
 
-  delete[] var_values;
+// Evaluates a quantifier-free body atom by atom. Each Apply or Eq whose
+// arguments are top-level variables or constants is computed as a whole
+// assignment-space bitset in one tight pass (its table index is affine in
+// the digits), and the connectives become word-wide operations.
+// Returns false for bodies it can't handle.
+//
+// Atom bitsets are cached by their affine index, so that pieces sharing a
+// quantifier prefix also share atoms; set_layout drops the cache when the
+// prefix changes.
+struct AtomBitsetEvaluator {
+  vector<int> sizes;
+  int pad_from;
+  vector<int> digit_of_var;
+
+  AtomBitsetEvaluator() : pad_from(0), has_valid(false) { }
+
+  void set_layout(vector<int> const& sizes, int pad_from);
+
+  struct LinearTerm {
+    FunctionInfo const* func; // NULL: the value is the index itself
+    long long base;
+    vector<long long> delta; // index change when digit k ticks
+  };
+
+  bool eval_body(EvalExpr const& ee, BitsetEvalResult& res);
+
+private:
+  map<vector<long long>, BitsetEvalResult> atom_cache;
+  BitsetEvalResult valid;
+  bool has_valid;
+
+  bool linear_term(EvalExpr const& ee, LinearTerm& t);
+  bool eval(EvalExpr const& ee, BitsetEvalResult& res);
+
+  void negate(BitsetEvalResult& res) {
+    for (uint64_t& w : res.v) {
+      w = ~w;
+    }
+  }
+};
+
+bool AtomBitsetEvaluator::linear_term(EvalExpr const& ee, LinearTerm& t)
+{
+  int n = sizes.size();
+  vector<long long> coef(n, 0);
+  t.func = NULL;
+  t.base = 0;
+
+  auto add_arg = [&](EvalExpr const& arg, long long stride) {
+    if (arg.type == EvalExprType::Const) {
+      t.base += stride * arg.const_value;
+      return true;
+    }
+    if (arg.type == EvalExprType::Var &&
+        arg.var_index < (int)digit_of_var.size()) {
+      coef[digit_of_var[arg.var_index]] += stride;
+      return true;
+    }
+    return false;
+  };
+
+  if (ee.type == EvalExprType::Apply) {
+    t.func = ee.function_info;
+    for (int i = 0; i < (int)t.func->strides.size(); i++) {
+      if (!add_arg(ee.args[i], t.func->strides[i])) {
+        return false;
+      }
+    }
+  } else if (!add_arg(ee, 1)) {
+    return false;
+  }
+
+  t.delta.resize(n);
+  long long wrapped = 0;
+  for (int k = 0; k < n; k++) {
+    t.delta[k] = coef[k] - wrapped;
+    wrapped += coef[k] * (sizes[k] - 1);
+  }
+  return true;
+}
+
+static void append_atom_key(vector<long long>& key,
+    AtomBitsetEvaluator::LinearTerm const& t)
+{
+  key.push_back((long long)(intptr_t)t.func);
+  key.push_back(t.base);
+  key.insert(key.end(), t.delta.begin(), t.delta.end());
+}
+
+void AtomBitsetEvaluator::set_layout(vector<int> const& sizes, int pad_from)
+{
+  if (sizes == this->sizes && pad_from == this->pad_from) {
+    return;
+  }
+  this->sizes = sizes;
+  this->pad_from = pad_from;
+  atom_cache.clear();
+  has_valid = false;
+}
+
+static inline object_value term_value(
+    AtomBitsetEvaluator::LinearTerm const& t, long long idx)
+{
+  return t.func == NULL ? (object_value)idx : t.func->dense[idx];
+}
+
+bool AtomBitsetEvaluator::eval(EvalExpr const& ee, BitsetEvalResult& res)
+{
+  switch (ee.type) {
+    case EvalExprType::Forall:
+    case EvalExprType::Exists:
+    case EvalExprType::NearlyForall:
+      return false;
+
+    case EvalExprType::Eq: {
+      LinearTerm a, b;
+      if (!linear_term(ee.args[0], a) || !linear_term(ee.args[1], b)) {
+        return false;
+      }
+      vector<long long> key;
+      append_atom_key(key, a);
+      append_atom_key(key, b);
+      auto iter = atom_cache.find(key);
+      if (iter != atom_cache.end()) {
+        res = iter->second;
+        return true;
+      }
+      long long ia = a.base;
+      long long ib = b.base;
+      pack_assignment_bits(sizes, pad_from, res,
+          [&]() { return (uint64_t)(term_value(a, ia) == term_value(b, ib)); },
+          [&](int k) { ia += a.delta[k]; ib += b.delta[k]; });
+      atom_cache.insert(make_pair(move(key), res));
+      return true;
+    }
+
+    case EvalExprType::Var:
+    case EvalExprType::Const:
+    case EvalExprType::Apply: {
+      LinearTerm a;
+      if (!linear_term(ee, a)) {
+        return false;
+      }
+      vector<long long> key;
+      append_atom_key(key, a);
+      auto iter = atom_cache.find(key);
+      if (iter != atom_cache.end()) {
+        res = iter->second;
+        return true;
+      }
+      long long ia = a.base;
+      pack_assignment_bits(sizes, pad_from, res,
+          [&]() { return (uint64_t)term_value(a, ia); },
+          [&](int k) { ia += a.delta[k]; });
+      atom_cache.insert(make_pair(move(key), res));
+      return true;
+    }
+
+    case EvalExprType::Not:
+      if (!eval(ee.args[0], res)) {
+        return false;
+      }
+      negate(res);
+      return true;
+
+    case EvalExprType::Implies: {
+      BitsetEvalResult b;
+      if (!eval(ee.args[0], res) || !eval(ee.args[1], b)) {
+        return false;
+      }
+      negate(res);
+      res.apply_disj(b);
+      return true;
+    }
+
+    case EvalExprType::And:
+    case EvalExprType::Or: {
+      bool conj = ee.type == EvalExprType::And;
+      if (ee.args.size() == 0) {
+        pack_assignment_bits(sizes, pad_from, res,
+            [&]() { return (uint64_t)conj; }, [](int) { });
+        return true;
+      }
+      if (!eval(ee.args[0], res)) {
+        return false;
+      }
+      for (int i = 1; i < (int)ee.args.size(); i++) {
+        BitsetEvalResult b;
+        if (!eval(ee.args[i], b)) {
+          return false;
+        }
+        if (conj) {
+          res.apply_conj(b);
+        } else {
+          res.apply_disj(b);
+        }
+      }
+      return true;
+    }
+
+    case EvalExprType::IfThenElse: {
+      BitsetEvalResult c, e;
+      if (!eval(ee.args[0], c) || !eval(ee.args[1], res) || !eval(ee.args[2], e)) {
+        return false;
+      }
+      res.apply_conj(c);
+      negate(c);
+      e.apply_conj(c);
+      res.apply_disj(e);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool AtomBitsetEvaluator::eval_body(EvalExpr const& ee, BitsetEvalResult& res)
+{
+  if (!eval(ee, res)) {
+    return false;
+  }
+
+  // Negation sets bits past the end and in padding; clear them.
+  if (!has_valid) {
+    valid.v.clear();
+    pack_assignment_bits(sizes, pad_from, valid,
+        []() { return (uint64_t)1; }, [](int) { });
+    has_valid = true;
+  }
+  res.apply_conj(valid);
+  res.last_bits = valid.last_bits;
+  return true;
+}
+
+// Evaluates `ee` at every assignment of the variables in `digit_of_var`
+// (variable i is digit digit_of_var[i], digit 0 varying fastest).
+static BitsetEvalResult eval_body_over_assignments(
+    EvalExpr const& ee, vector<int> const& sizes,
+    vector<int> const& digit_of_var, int pad_from,
+    AtomBitsetEvaluator& abe)
+{
+  BitsetEvalResult ber;
+
+  abe.set_layout(sizes, pad_from);
+  abe.digit_of_var = digit_of_var;
+  if (abe.eval_body(ee, ber)) {
+    return ber;
+  }
+  ber.v.clear();
+
+  int n = sizes.size();
+  int n_vars = max(max_var(ee) + 1, n);
+  EvalProgram prog = EvalProgram::compile(ee, n_vars);
+  vector<object_value> regs = prog.init_regs;
+  vector<int> var_of_digit(n);
+  for (int i = 0; i < n; i++) {
+    regs[i] = 0;
+    var_of_digit[digit_of_var[i]] = i;
+  }
+
+  object_value* r = regs.data();
+  pack_assignment_bits(sizes, pad_from, ber,
+      [&]() { return (uint64_t)prog.run(r); },
+      [&](int k) {
+        for (int j = 0; j < k; j++) {
+          r[var_of_digit[j]] = 0;
+        }
+        r[var_of_digit[k]]++;
+      });
+  return ber;
+}
+
+BitsetEvalResult BitsetEvalResult::eval_over_foralls(shared_ptr<Model> model, value val)
+{
+  //model->dump();
+  //cout << "eval'ing for value: " << val->to_string() << endl;
+
+  auto p = get_tqd_and_body(val);
+  TopQuantifierDesc const& tqd = p.first;
+  value bodyval = p.second;
+  vector<VarDecl> decls = tqd.decls();
+  vector<iden> names;
+  for (VarDecl const& decl : decls) {
+    names.push_back(decl.name);
+  }
+  EvalExpr ee = model->value_to_eval_expr(bodyval, names);
+
+  vector<int> sizes;
+  vector<int> digit_of_var;
+  for (int i = 0; i < (int)decls.size(); i++) {
+    sizes.push_back(model->get_domain_size(decls[i].sort));
+    digit_of_var.push_back(i);
+  }
+
+  AtomBitsetEvaluator abe;
+  BitsetEvalResult ber = eval_body_over_assignments(
+      ee, sizes, digit_of_var, decls.size(), abe);
   //ber.dump();
   return ber;
 }
@@ -1273,6 +1872,9 @@ AlternationBitsetEvaluator AlternationBitsetEvaluator::make_evaluator(
   int p = 1;
   for (int i = 0; i < (int)sizes.size() - 1; i++) {
     p *= sizes[i];
+    if (i == 0 && pad_bitset_blocks) {
+      p = (p + 63) / 64 * 64;
+    }
     abe.levels[abe.levels.size() - 1 - i].block_size = p;
     abe.levels[abe.levels.size() - 1 - i].num_blocks = sizes[i+1];
     abe.levels[abe.levels.size() - 1 - i].conj = alternations[i+1].is_forall();
@@ -1299,8 +1901,8 @@ AlternationBitsetEvaluator AlternationBitsetEvaluator::make_evaluator(
   return abe;
 }
 
-BitsetEvalResult BitsetEvalResult::eval_over_alternating_quantifiers(
-    shared_ptr<Model> model, value val)
+static BitsetEvalResult eval_over_alternating_quantifiers(
+    shared_ptr<Model> model, value val, AtomBitsetEvaluator& abe)
 {
   //model->dump();
   //cout << "eval'ing for value: " << val->to_string() << endl;
@@ -1321,57 +1923,51 @@ BitsetEvalResult BitsetEvalResult::eval_over_alternating_quantifiers(
   }
   EvalExpr ee = model->value_to_eval_expr(bodyval, names);
 
-  int n_vars = max(max_var(ee), (int)decls.size()) + 1;
-  int* var_values = new int[n_vars];
-
-  BitsetEvalResult ber;
-  vector<int> max_sizes;
-  max_sizes.resize(decls.size());
-  for (int i = 0; i < (int)decls.size(); i++) {
-    max_sizes[i] = model->get_domain_size(decls[i].sort);
-    var_values[i] = 0;
+  // The outermost alternation's variables come last and vary fastest.
+  // When padding, start a new word whenever one of the others changes.
+  int n = decls.size();
+  int outer_start = 0;
+  if (pad_bitset_blocks && alternations.size() > 1) {
+    outer_start = n - alternations[0].decls.size();
   }
 
-  uint64_t cur = 0;
-  int bit_place = 0;
-  while (true) {
-    //cout << "bp: " << bit_place << endl;
-    int ans = eval(ee, var_values);
-    assert(ans == 0 || ans == 1);
-    cur |= ((uint64_t)ans << bit_place);
-    bit_place++;
-    if (bit_place == 64) {
-      ber.v.push_back(cur);
-      cur = 0;
-      bit_place = 0;
-    }
-
-    int i;
-    for (i = (int)decls.size() - 1; i >= 0; i--) {
-      var_values[i]++;
-      if (var_values[i] == max_sizes[i]) {
-        var_values[i] = 0;
-      } else {
-        break;
-      }
-    }
-    if (i == -1) {
-      break;
-    }
-  }
-
-  if (bit_place > 0) {
-    ber.v.push_back(cur);
-    ber.last_bits = ((uint64_t)1 << bit_place) - 1;
-  } else {
-    ber.last_bits = (uint64_t)(-1);
+  vector<int> sizes;
+  vector<int> digit_of_var(n);
+  for (int i = n - 1; i >= 0; i--) {
+    sizes.push_back(model->get_domain_size(decls[i].sort));
+    digit_of_var[i] = n - 1 - i;
   }
 
-  delete[] var_values;
+  BitsetEvalResult ber = eval_body_over_assignments(
+      ee, sizes, digit_of_var, n - outer_start, abe);
   //ber.dump();
   return ber;
 }
 
+BitsetEvalResult BitsetEvalResult::eval_over_alternating_quantifiers(
+    shared_ptr<Model> model, value val)
+{
+  AtomBitsetEvaluator abe;
+  return ::eval_over_alternating_quantifiers(model, val, abe);
+}
+
+BitsetEvalMatrix BitsetEvalMatrix::eval_over_alternating_quantifiers(
+    shared_ptr<Model> model, vector<value> const& pieces)
+{
+  // The pieces normally share one quantifier prefix, and so most atoms.
+  AtomBitsetEvaluator abe;
+  BitsetEvalMatrix m;
+  for (int j = 0; j < (int)pieces.size(); j++) {
+    BitsetEvalResult ber =
+        ::eval_over_alternating_quantifiers(model, pieces[j], abe);
+    if (j == 0) {
+      m.resize(pieces.size(), ber.v.size());
+    }
+    m.set_row(j, ber);
+  }
+  return m;
+}
+
 vector<size_t> Model::get_domain_sizes_for_function(iden name) const {
   lsort sort;
   for (VarDecl decl : module->functions) {
@@ -1395,18 +1991,8 @@ vector<size_t> Model::get_domain_sizes_for_function(iden name) const {
 object_value Model::func_eval(iden name, std::vector<object_value> const& args)
 {
   FunctionInfo const& finfo = get_function_info(name);
-  FunctionTable* ftable = finfo.table.get();
-  for (int i = 0; i < (int)args.size(); i++) {
-    if (ftable == NULL) break;
-    assert (args[i] < ftable->children.size());
-    ftable = ftable->children[args[i]].get();
-  }
-  if (ftable != NULL) {
-    assert (ftable->children.size() == 0);
-    return ftable->value;
-  } else {
-    return finfo.else_value;
-  }
+  assert (args.size() == finfo.strides.size());
+  return finfo.lookup(args.data());
 }
 
 std::vector<FunctionEntry> Model::getFunctionEntries(iden name)
@@ -1445,20 +2031,8 @@ std::vector<FunctionEntry> Model::getFunctionEntries(iden name)
   }
   while (true) {
     FunctionEntry entry;
-
-    FunctionTable* ftable = finfo.table.get();
-    for (int i = 0; i < (int)num_args; i++) {
-      if (ftable == NULL) break;
-      ftable = ftable->children[args[i]].get();
-    }
-    for (int i = 0; i < (int)num_args; i++) {
-      entry.args.push_back(args[i]);
-    }
-    if (ftable != NULL) {
-      entry.res = ftable->value;
-    } else {
-      entry.res = finfo.else_value;
-    }
+    entry.args = args;
+    entry.res = finfo.lookup(args.data());
     entries.push_back(entry);
 
     int i;
@@ -1551,6 +2125,47 @@ Json FunctionTable::to_json() const {
   }
 }
 
+static void fill_dense(FunctionTable const* ftable, object_value else_value,
+    vector<size_t> const& domain_sizes, int depth, size_t offset, size_t stride,
+    vector<object_value>& dense)
+{
+  if (ftable == NULL || depth == (int)domain_sizes.size()) {
+    object_value v = ftable == NULL ? else_value : ftable->value;
+    for (size_t i = 0; i < stride; i++) {
+      dense[offset + i] = v;
+    }
+    return;
+  }
+  size_t sub = stride / domain_sizes[depth];
+  for (size_t i = 0; i < domain_sizes[depth]; i++) {
+    fill_dense(ftable->children[i].get(), else_value, domain_sizes, depth + 1,
+        offset + i * sub, sub, dense);
+  }
+}
+
+void FunctionInfo::build_dense(vector<size_t> const& domain_sizes)
+{
+  size_t total = 1;
+  for (size_t d : domain_sizes) {
+    total *= d;
+  }
+  strides.resize(domain_sizes.size());
+  size_t s = total;
+  for (int i = 0; i < (int)domain_sizes.size(); i++) {
+    s /= domain_sizes[i];
+    strides[i] = s;
+  }
+  dense.resize(total);
+  fill_dense(table.get(), else_value, domain_sizes, 0, 0, total, dense);
+}
+
+void Model::build_dense_tables()
+{
+  for (auto& p : function_info) {
+    p.second.build_dense(get_domain_sizes_for_function(p.first));
+  }
+}
+
 unique_ptr<FunctionTable> FunctionTable::from_json(Json j) {
   unique_ptr<FunctionTable> ft;
   if (j.is_null()) {
@@ -1568,3 +2183,119 @@ unique_ptr<FunctionTable> FunctionTable::from_json(Json j) {
   return ft;
 }
 
+
+static void write_u32(string& out, uint32_t x) {
+  out.append((char const*)&x, sizeof(x));
+}
+
+static uint32_t read_u32(string const& s, size_t& pos) {
+  assert(pos + sizeof(uint32_t) <= s.size());
+  uint32_t x;
+  memcpy(&x, s.data() + pos, sizeof(x));
+  pos += sizeof(x);
+  return x;
+}
+
+static void write_string(string& out, string const& t) {
+  write_u32(out, t.size());
+  out.append(t);
+}
+
+static string read_string(string const& s, size_t& pos) {
+  uint32_t len = read_u32(s, pos);
+  assert(pos + len <= s.size());
+  string t = s.substr(pos, len);
+  pos += len;
+  return t;
+}
+
+void Model::to_binary(string& out) const {
+  write_u32(out, sort_info.size());
+  for (auto& p : sort_info) {
+    write_string(out, p.first);
+    write_u32(out, p.second.domain_size);
+  }
+
+  write_u32(out, function_info.size());
+  for (auto& p : function_info) {
+    write_string(out, iden_to_string(p.first));
+    p.second.to_binary(out);
+  }
+}
+
+shared_ptr<Model> Model::from_binary(string const& s, size_t& pos, shared_ptr<Module> module) {
+  std::unordered_map<std::string, SortInfo> sort_info;
+  std::unordered_map<iden, FunctionInfo> function_info;
+
+  uint32_t nsorts = read_u32(s, pos);
+  for (uint32_t i = 0; i < nsorts; i++) {
+    string name = read_string(s, pos);
+    SortInfo si;
+    si.domain_size = read_u32(s, pos);
+    sort_info.insert(make_pair(name, si));
+  }
+
+  uint32_t nfuncs = read_u32(s, pos);
+  for (uint32_t i = 0; i < nfuncs; i++) {
+    string name = read_string(s, pos);
+    function_info.insert(make_pair(string_to_iden(name), FunctionInfo::from_binary(s, pos)));
+  }
+
+  return shared_ptr<Model>(new Model(module, move(sort_info), move(function_info)));
+}
+
+void FunctionInfo::to_binary(string& out) const {
+  write_u32(out, else_value);
+  if (table == nullptr) {
+    out.push_back('n');
+  } else {
+    table->to_binary(out);
+  }
+}
+
+FunctionInfo FunctionInfo::from_binary(string const& s, size_t& pos) {
+  FunctionInfo fi;
+  fi.else_value = (object_value) read_u32(s, pos);
+  fi.table = FunctionTable::from_binary(s, pos);
+  return fi;
+}
+
+// Each table is tagged: 'n' (null), 'v' (leaf value), 't' (children)
+void FunctionTable::to_binary(string& out) const {
+  if (children.size() > 0) {
+    out.push_back('t');
+    write_u32(out, children.size());
+    for (auto& ftable : children) {
+      if (ftable == nullptr) {
+        out.push_back('n');
+      } else {
+        ftable->to_binary(out);
+      }
+    }
+  } else {
+    out.push_back('v');
+    write_u32(out, value);
+  }
+}
+
+unique_ptr<FunctionTable> FunctionTable::from_binary(string const& s, size_t& pos) {
+  assert(pos < s.size());
+  char tag = s[pos];
+  pos++;
+
+  unique_ptr<FunctionTable> ft;
+  if (tag == 'n') {
+    return ft;
+  } else if (tag == 't') {
+    ft.reset(new FunctionTable());
+    uint32_t n = read_u32(s, pos);
+    for (uint32_t i = 0; i < n; i++) {
+      ft->children.push_back(FunctionTable::from_binary(s, pos));
+    }
+  } else {
+    assert(tag == 'v');
+    ft.reset(new FunctionTable());
+    ft->value = (object_value) read_u32(s, pos);
+  }
+  return ft;
+}
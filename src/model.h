@@ -23,6 +23,9 @@ public:
 
   json11::Json to_json() const;
   static std::unique_ptr<FunctionTable> from_json(json11::Json);
+
+  void to_binary(std::string& out) const;
+  static std::unique_ptr<FunctionTable> from_binary(std::string const&, size_t& pos);
 };
 
 class FunctionInfo {
@@ -30,8 +33,26 @@ public:
   object_value else_value;
   std::unique_ptr<FunctionTable> table;
 
+  // `table` flattened, indexed by the sum of args[i] * strides[i], with the
+  // else_value filled in. Built by the Model constructor.
+  std::vector<object_value> dense;
+  std::vector<size_t> strides;
+
+  void build_dense(std::vector<size_t> const& domain_sizes);
+
+  object_value lookup(object_value const* args) const {
+    size_t idx = 0;
+    for (int i = 0; i < (int)strides.size(); i++) {
+      idx += args[i] * strides[i];
+    }
+    return dense[idx];
+  }
+
   json11::Json to_json() const;
   static FunctionInfo from_json(json11::Json);
+
+  void to_binary(std::string& out) const;
+  static FunctionInfo from_binary(std::string const&, size_t& pos);
 };
 
 class FunctionEntry {
@@ -81,6 +102,12 @@ public:
       ModelEmbedding const& e);
 
 private:
+  // Domain size of each of `sorts` in the solver's current model, without
+  // extracting the model
+  static std::vector<int> z3_domain_sizes(
+      smt::context& ctx,
+      smt::solver& solver,
+      std::vector<smt::sort> const& sorts);
   static std::shared_ptr<Model> extract_z3(
       smt::context& ctx,
       smt::solver& solver,
@@ -118,6 +145,12 @@ public:
   json11::Json to_json() const;
   static std::shared_ptr<Model> from_json(json11::Json, std::shared_ptr<Module>);
 
+  // Compact encoding, appended to `out`. Names are stored as strings,
+  // so it can be read back by a different process.
+  void to_binary(std::string& out) const;
+  static std::shared_ptr<Model> from_binary(std::string const&, size_t& pos,
+      std::shared_ptr<Module>);
+
 private:
   std::shared_ptr<Module> module;
 
@@ -134,13 +167,18 @@ public:
     std::unordered_map<std::string, SortInfo>&& sort_info,
     std::unordered_map<iden, FunctionInfo>&& function_info) :
         module(module), sort_info(std::move(sort_info)),
-        function_info(std::move(function_info)) { }
+        function_info(std::move(function_info)) {
+    build_dense_tables();
+  }
 
 private:
+  void build_dense_tables();
+
   std::map<std::pair<iden, object_value>, std::shared_ptr<FTree>> ftree_cache;
   std::shared_ptr<FTree> constructFunctionFTree(iden name, object_value res);
 
   friend bool are_models_isomorphic(std::shared_ptr<Model>, std::shared_ptr<Model>);
+  friend uint64_t model_canonical_hash(std::shared_ptr<Model>);
 };
 
 std::shared_ptr<Model> transition_model(
@@ -4,6 +4,150 @@
 
 using namespace std;
 
+// Index of `so` in module->sorts, or -1 if it is not uninterpreted.
+static int get_sort_idx(shared_ptr<Module> module, lsort so)
+{
+  for (int i = 0; i < (int)module->sorts.size(); i++) {
+    if (sorts_eq(so, s_uninterp(module->sorts[i]))) {
+      return i;
+    }
+  }
+  assert(dynamic_cast<BooleanSort*>(so.get()) != NULL);
+  return -1;
+}
+
+static uint64_t mix(uint64_t h, uint64_t x) {
+  h ^= x + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+  return h;
+}
+
+// Colors of the elements of a model, refined until stable: an element's
+// color depends only on its sort and on the colors of the function entries
+// it takes part in. An isomorphism maps each element to one of the same
+// color, so models with different `hash` are never isomorphic.
+struct ModelColoring {
+  // indexed by [sort index][element]
+  vector<vector<uint64_t>> colors;
+  uint64_t hash;
+};
+
+static ModelColoring color_model(shared_ptr<Model> m, shared_ptr<Module> module)
+{
+  ModelColoring mc;
+  int num_elements = 0;
+  for (int s = 0; s < (int)module->sorts.size(); s++) {
+    int n = m->get_domain_size(module->sorts[s]);
+    mc.colors.push_back(vector<uint64_t>(n, mix(0, s + 1)));
+    num_elements += n;
+  }
+
+  struct Func {
+    FunctionInfo const* finfo;
+    vector<int> arg_sorts;
+    vector<size_t> domain_sizes;
+    int range_sort;
+  };
+  vector<Func> funcs;
+  for (VarDecl const& decl : module->functions) {
+    Func f;
+    f.finfo = &m->get_function_info(decl.name);
+    for (lsort so : decl.sort->get_domain_as_function()) {
+      // Like is_function_iso, this assumes there are no boolean arguments
+      int s = get_sort_idx(module, so);
+      assert (s != -1);
+      f.arg_sorts.push_back(s);
+    }
+    f.domain_sizes = m->get_domain_sizes_for_function(decl.name);
+    f.range_sort = get_sort_idx(module, decl.sort->get_range_as_function());
+    funcs.push_back(move(f));
+  }
+
+  auto count_colors = [&]() {
+    vector<uint64_t> all;
+    for (auto const& cs : mc.colors) {
+      all.insert(all.end(), cs.begin(), cs.end());
+    }
+    sort(all.begin(), all.end());
+    return (int)(unique(all.begin(), all.end()) - all.begin());
+  };
+
+  // Each round, every function entry gets a signature from the colors of
+  // its arguments and result, and each element adds up the signatures of
+  // the entries it appears in (a sum, so the order of entries is
+  // irrelevant). The sum of all signatures goes into the hash.
+  uint64_t entries_sum = 0;
+  int num_colors = count_colors();
+  for (int round = 0; round <= num_elements; round++) {
+    vector<vector<uint64_t>> sums(mc.colors.size());
+    for (int s = 0; s < (int)mc.colors.size(); s++) {
+      sums[s].resize(mc.colors[s].size(), 0);
+    }
+    entries_sum = 0;
+
+    for (int fi = 0; fi < (int)funcs.size(); fi++) {
+      Func const& f = funcs[fi];
+      int k = f.arg_sorts.size();
+      vector<object_value> args(k, 0);
+      while (true) {
+        object_value res = f.finfo->lookup(args.data());
+        uint64_t sig = mix(0, fi + 1);
+        for (int i = 0; i < k; i++) {
+          sig = mix(sig, mc.colors[f.arg_sorts[i]][args[i]]);
+        }
+        sig = mix(sig, f.range_sort == -1 ? res : mc.colors[f.range_sort][res]);
+        entries_sum += sig;
+
+        for (int i = 0; i < k; i++) {
+          sums[f.arg_sorts[i]][args[i]] += mix(sig, i + 1);
+        }
+        if (f.range_sort != -1) {
+          sums[f.range_sort][res] += mix(sig, 0);
+        }
+
+        int i;
+        for (i = 0; i < k; i++) {
+          args[i]++;
+          if (args[i] == f.domain_sizes[i]) {
+            args[i] = 0;
+          } else {
+            break;
+          }
+        }
+        if (i == k) {
+          break;
+        }
+      }
+    }
+
+    for (int s = 0; s < (int)mc.colors.size(); s++) {
+      for (int e = 0; e < (int)mc.colors[s].size(); e++) {
+        mc.colors[s][e] = mix(mc.colors[s][e], sums[s][e]);
+      }
+    }
+
+    int new_num_colors = count_colors();
+    if (new_num_colors == num_colors) {
+      break;
+    }
+    num_colors = new_num_colors;
+  }
+
+  mc.hash = mix(0, entries_sum);
+  for (auto const& cs : mc.colors) {
+    uint64_t sum = 0;
+    for (uint64_t c : cs) {
+      sum += mix(c, 1);
+    }
+    mc.hash = mix(mix(mc.hash, cs.size()), sum);
+  }
+  return mc;
+}
+
+uint64_t model_canonical_hash(shared_ptr<Model> m)
+{
+  return color_model(m, m->module).hash;
+}
+
 bool is_function_iso(shared_ptr<Model> m1, shared_ptr<Model> m2,
     shared_ptr<Module> module,
     VarDecl const& decl,
@@ -15,17 +159,13 @@ bool is_function_iso(shared_ptr<Model> m1, shared_ptr<Model> m2,
   for (lsort so : decl.sort->get_domain_as_function()) {
     domain_sizes.push_back(m1->get_domain_size(so));
     args.push_back(0);
-    for (int i = 0; i < (int)module->sorts.size(); i++) {
-      if (sorts_eq(so, s_uninterp(module->sorts[i]))) {
-        idx_for_arg.push_back(i);
-        goto end_of_loop;
-      }
-    }
-    assert(false);
-    end_of_loop: {}
+    idx_for_arg.push_back(get_sort_idx(module, so));
   }
+  int range_idx = get_sort_idx(module, decl.sort->get_range_as_function());
 
   int n = args.size();
+  FunctionInfo const& finfo1 = m1->get_function_info(decl.name);
+  FunctionInfo const& finfo2 = m2->get_function_info(decl.name);
 
   while (true) {
     vector<object_value> perm_args(n);
@@ -33,8 +173,11 @@ bool is_function_iso(shared_ptr<Model> m1, shared_ptr<Model> m2,
       perm_args[i] = perms[idx_for_arg[i]][args[i]];
     }
 
-    object_value v1 = m1->func_eval(decl.name, args);
-    object_value v2 = m1->func_eval(decl.name, perm_args);
+    object_value v1 = finfo1.lookup(args.data());
+    object_value v2 = finfo2.lookup(perm_args.data());
+    if (range_idx != -1) {
+      v1 = perms[range_idx][v1];
+    }
 
     if (v1 != v2) {
       return false;
@@ -57,8 +200,12 @@ bool is_function_iso(shared_ptr<Model> m1, shared_ptr<Model> m2,
   return true;
 }
 
+// Tries the permutations of each sort in turn, only mapping elements to
+// elements of the same color.
 bool do_test(shared_ptr<Model> m1, shared_ptr<Model> m2,
     shared_ptr<Module> module,
+    ModelColoring const& c1,
+    ModelColoring const& c2,
     vector<vector<int>> const& perms)
 {
   if (module->sorts.size() == perms.size()) {
@@ -70,16 +217,26 @@ bool do_test(shared_ptr<Model> m1, shared_ptr<Model> m2,
     return true;
   } else {
     int idx = perms.size();
-    string sort = module->sorts[idx];
+    vector<uint64_t> const& col1 = c1.colors[idx];
+    vector<uint64_t> const& col2 = c2.colors[idx];
     vector<int> perm;
-    int n = m1->get_domain_size(sort);
+    int n = col1.size();
     for (int i = 0; i < n; i++) {
       perm.push_back(i);
     }
     do {
+      bool ok = true;
+      for (int i = 0; i < n; i++) {
+        if (col1[i] != col2[perm[i]]) {
+          ok = false;
+          break;
+        }
+      }
+      if (!ok) continue;
+
       vector<vector<int>> new_perms = perms;
-      new_perms.push_back(perm); 
-      if (do_test(m1, m2, module, new_perms)) {
+      new_perms.push_back(perm);
+      if (do_test(m1, m2, module, c1, c2, new_perms)) {
         return true;
       }
     } while (next_permutation(perm.begin(), perm.end()));
@@ -100,5 +257,11 @@ bool are_models_isomorphic(shared_ptr<Model> m1, shared_ptr<Model> m2)
     }
   }
 
-  return do_test(m1, m2, module, {});
+  ModelColoring c1 = color_model(m1, module);
+  ModelColoring c2 = color_model(m2, module);
+  if (c1.hash != c2.hash) {
+    return false;
+  }
+
+  return do_test(m1, m2, module, c1, c2, {});
 }
@@ -5,4 +5,7 @@
 
 bool are_models_isomorphic(std::shared_ptr<Model> m1, std::shared_ptr<Model> m2);
 
+// Hash that is equal for isomorphic models (but may collide for others)
+uint64_t model_canonical_hash(std::shared_ptr<Model> m);
+
 #endif
@@ -9,7 +9,7 @@
 using namespace std;
 
 vector<value> get_disjuncts(value v) {
-  if (Or* o = dynamic_cast<Or*>(v.get())) {
+  if (Or* o = value_cast<Or>(v.get())) {
     return o->args;
   } else {
     return {v};
@@ -55,8 +55,8 @@ vector<value> all_sub_disjunctions(value v)
 
 bool obviously_implies(shared_ptr<Module> module, value a, value b)
 {
-  Forall* af = dynamic_cast<Forall*>(a.get())
-  Forall* bf = dynamic_cast<Forall*>(b.get())
+  Forall* af = value_cast<Forall>(a.get())
+  Forall* bf = value_cast<Forall>(b.get())
   if (af != NULL) {
     assert (bf != NULL);
     assert (af.decls == bf.decls);
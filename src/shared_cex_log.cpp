@@ -0,0 +1,102 @@
+#include "shared_cex_log.h"
+
+#include <cassert>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+const uint32_t CEX_LOG_MAGIC = 0x43455831; // "CEX1"
+
+struct CexLogHeader {
+  uint32_t magic;
+  uint32_t writer_id;
+  uint32_t len;
+};
+
+SharedCexLog::SharedCexLog(string const& filename, shared_ptr<Module> module)
+  : module(module)
+  , writer_id(getpid())
+  , read_offset(0)
+{
+  fd = open(filename.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+  if (fd == -1) {
+    cout << "could not open shared cex log " << filename << endl;
+    assert(false);
+  }
+}
+
+SharedCexLog::~SharedCexLog()
+{
+  close(fd);
+}
+
+void SharedCexLog::append(Counterexample const& cex)
+{
+  string payload = cex.to_binary();
+
+  CexLogHeader header;
+  header.magic = CEX_LOG_MAGIC;
+  header.writer_id = writer_id;
+  header.len = payload.size();
+
+  string record((char const*)&header, sizeof(header));
+  record += payload;
+
+  flock(fd, LOCK_EX);
+  size_t written = 0;
+  while (written < record.size()) {
+    ssize_t w = write(fd, record.data() + written, record.size() - written);
+    assert(w > 0);
+    written += w;
+  }
+  flock(fd, LOCK_UN);
+}
+
+vector<Counterexample> SharedCexLog::poll()
+{
+  vector<Counterexample> res;
+
+  flock(fd, LOCK_SH);
+
+  struct stat st;
+  int r = fstat(fd, &st);
+  assert(r == 0);
+  size_t size = st.st_size;
+
+  if (size > read_offset) {
+    // Map only from the page that holds read_offset
+    static size_t const page_size = sysconf(_SC_PAGESIZE);
+    size_t map_offset = read_offset - read_offset % page_size;
+    size_t map_len = size - map_offset;
+    void* p = mmap(nullptr, map_len, PROT_READ, MAP_SHARED, fd, map_offset);
+    assert(p != MAP_FAILED);
+    char const* data = (char const*)p;
+
+    while (read_offset + sizeof(CexLogHeader) <= size) {
+      CexLogHeader header;
+      memcpy(&header, data + (read_offset - map_offset), sizeof(header));
+      assert(header.magic == CEX_LOG_MAGIC);
+      size_t start = read_offset + sizeof(header);
+      assert(start + header.len <= size);
+
+      if (header.writer_id != writer_id) {
+        string payload(data + (start - map_offset), header.len);
+        res.push_back(Counterexample::from_binary(payload, module));
+      }
+      read_offset = start + header.len;
+    }
+
+    munmap(p, map_len);
+  }
+
+  flock(fd, LOCK_UN);
+
+  return res;
+}
@@ -0,0 +1,35 @@
+#ifndef SHARED_CEX_LOG_H
+#define SHARED_CEX_LOG_H
+
+#include "synth_enumerator.h"
+
+#include <string>
+#include <vector>
+
+// Append-only file of counterexamples, shared by all the synthesis
+// processes working on the same problem so that they don't have to
+// rediscover each other's counterexamples through SMT.
+//
+// Each record is a header (magic, writer pid, length) followed by the
+// binary encoding of the Counterexample. Records are written with a single
+// write() while holding an exclusive flock, and read through mmap while
+// holding a shared one, so readers never see a partial record.
+class SharedCexLog {
+public:
+  SharedCexLog(std::string const& filename, std::shared_ptr<Module> module);
+  ~SharedCexLog();
+
+  void append(Counterexample const& cex);
+
+  // Returns the counterexamples appended by other processes since
+  // the last call.
+  std::vector<Counterexample> poll();
+
+private:
+  std::shared_ptr<Module> module;
+  int fd;
+  uint32_t writer_id;
+  size_t read_offset;
+};
+
+#endif
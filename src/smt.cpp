@@ -1,6 +1,7 @@
 #include "smt.h"
 
 #include <map> 
+#include <atomic>
 #include <fstream> 
 #include <iostream> 
 
@@ -11,7 +12,10 @@ using namespace std;
 bool enable_smt_logging = false;
 extern int run_id;
 
-thread_local map<string, pair<long long, long long>> stats;
+thread_local smt::SmtStats stats;
+
+atomic<long long> smt_cache_hits(0);
+atomic<long long> smt_cache_misses(0);
 
 namespace smt {
 
@@ -81,6 +85,31 @@ void dump_smt_stats() {
     cout << p.first << " total " << ms << " ms over " << num
          << " ops, average is " << avg << " ms" << endl;
   }
+  if (smt_cache_hits + smt_cache_misses > 0) {
+    cout << "smt cache: " << smt_cache_hits << " hits, "
+         << smt_cache_misses << " misses" << endl;
+  }
+}
+
+void count_smt_cache_lookup(bool hit) {
+  if (hit) {
+    smt_cache_hits++;
+  } else {
+    smt_cache_misses++;
+  }
+}
+
+SmtStats take_smt_stats() {
+  SmtStats res;
+  swap(res, stats);
+  return res;
+}
+
+void add_smt_stats(SmtStats const& other) {
+  for (auto& p : other) {
+    stats[p.first].first += p.second.first;
+    stats[p.first].second += p.second.second;
+  }
 }
 
 }
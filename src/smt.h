@@ -1,6 +1,7 @@
 #ifndef SMT_H
 #define SMT_H
 
+#include <map>
 #include <memory>
 #include <vector>
 #include <string>
@@ -81,6 +82,13 @@ namespace smt {
   struct _context {
     virtual ~_context() { }
     virtual void set_timeout(int ms) = 0;
+    // Seed for the random choices of solvers made after this call
+    virtual void set_seed(unsigned seed) = 0;
+    // Stops a check running on this context (from another thread), which
+    // then returns unknown. With Z3, an interrupt that comes before a check
+    // has started is lost, and one that comes while no check is running
+    // fails push and get_model until the next check.
+    virtual void interrupt() = 0;
     virtual std::shared_ptr<_sort> bool_sort() = 0;
     virtual std::shared_ptr<_expr> bool_val(bool) = 0;
     virtual std::shared_ptr<_sort> uninterpreted_sort(std::string const& name) = 0;
@@ -122,6 +130,14 @@ namespace smt {
       p->set_timeout(ms);
     }
 
+    void set_seed(unsigned seed) {
+      p->set_seed(seed);
+    }
+
+    void interrupt() {
+      p->interrupt();
+    }
+
     sort bool_sort() { return p->bool_sort(); }
     expr bool_val(bool b) { return p->bool_val(b); }
     sort uninterpreted_sort(std::string const& name) {
@@ -197,9 +213,12 @@ namespace smt {
     std::string log_info;
     void set_log_info(std::string const& s) { log_info = s; }
     void log_smtlib(long long ms, std::string const& res);
-    virtual void dump(std::ofstream& of) = 0;
+    virtual void dump(std::ostream& of) = 0;
 
     virtual SolverResult check_result() = 0;
+    // Check with `assumptions` (boolean constants) taken as true for this
+    // check only
+    virtual SolverResult check_result(_expr_vector* assumptions) = 0;
     bool check_sat() {
       SolverResult res = check_result();
       assert (res == SolverResult::Sat || res == SolverResult::Unsat);
@@ -218,11 +237,16 @@ namespace smt {
     void set_log_info(std::string const& s) { p->set_log_info(s); }
     
     SolverResult check_result() { return p->check_result(); }
+    SolverResult check_result(expr_vector assumptions) {
+      return p->check_result(assumptions.p.get());
+    }
     bool check_sat() { return p->check_sat(); }
 
     void push() { p->push(); }
     void pop() { p->pop(); }
     void add(expr e) { p->add(e.p.get()); }
+
+    void dump(std::ostream& of) { p->dump(of); }
   };
 
   inline expr forall(expr_vector args, expr body) {
@@ -299,6 +323,15 @@ namespace smt {
 
   bool is_z3_context(context&);
   void dump_smt_stats();
+
+  // The stats printed by dump_smt_stats() are kept per thread. A thread
+  // that ran checks on behalf of another hands them over with these.
+  typedef std::map<std::string, std::pair<long long, long long>> SmtStats;
+  SmtStats take_smt_stats();
+  void add_smt_stats(SmtStats const&);
+
+  // For the on-disk query cache (see smt_cache.h)
+  void count_smt_cache_lookup(bool hit);
 }
 
 #endif
@@ -0,0 +1,187 @@
+#include "smt_cache.h"
+
+#include <cassert>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+
+#include <unistd.h>
+
+#include "lib/json11/json11.hpp"
+
+using namespace std;
+using namespace json11;
+
+string smt_cache_dir;
+
+// Is `tok` a name made by name() in contexts.cpp, "x<rand>_<base>__<count>"?
+// If so, sets `base`.
+static bool is_generated_name(string const& tok, string& base) {
+  size_t n = tok.size();
+  size_t i = 1;
+  if (n < 2 || tok[0] != 'x' || !isdigit(tok[1])) {
+    return false;
+  }
+  while (i < n && isdigit(tok[i])) i++;
+  if (i == n || tok[i] != '_') {
+    return false;
+  }
+  size_t j = n;
+  while (j > i && isdigit(tok[j - 1])) j--;
+  if (j == n || j < i + 3 || tok[j - 1] != '_' || tok[j - 2] != '_') {
+    return false;
+  }
+  base = tok.substr(i + 1, j - 2 - (i + 1));
+  return true;
+}
+
+static bool is_delimiter(char c) {
+  return isspace(c) || c == '(' || c == ')' || c == '|';
+}
+
+// Replaces each generated name with "<base>__<k>", numbering the names by
+// first appearance, so the same query gives the same text in every run.
+static string normalize_names(string const& text) {
+  unordered_map<string, int> ids;
+  string res;
+  res.reserve(text.size());
+  size_t i = 0;
+  while (i < text.size()) {
+    if (is_delimiter(text[i])) {
+      res += text[i];
+      i++;
+      continue;
+    }
+    size_t j = i;
+    while (j < text.size() && !is_delimiter(text[j])) j++;
+    string tok = text.substr(i, j - i);
+    string base;
+    if (is_generated_name(tok, base)) {
+      auto it = ids.find(tok);
+      int id;
+      if (it != ids.end()) {
+        id = it->second;
+      } else {
+        id = ids.size();
+        ids.insert(make_pair(tok, id));
+      }
+      res += base + "__" + to_string(id);
+    } else {
+      res += tok;
+    }
+    i = j;
+  }
+  return res;
+}
+
+// Two independent 64-bit hashes of `s`, as 32 hex digits
+static string hash128(string const& s) {
+  uint64_t h1 = 0xcbf29ce484222325ULL;
+  uint64_t h2 = 0x6a09e667f3bcc909ULL;
+  for (unsigned char c : s) {
+    h1 = (h1 ^ c) * 0x100000001b3ULL;
+    h2 = (h2 ^ c) * 0x9e3779b97f4a7c15ULL;
+    h2 ^= h2 >> 29;
+  }
+  char buf[33];
+  snprintf(buf, sizeof(buf), "%016llx%016llx",
+      (unsigned long long)h1, (unsigned long long)h2);
+  return buf;
+}
+
+string smt_cache_key(
+    shared_ptr<Module> module,
+    string const& log_info,
+    ModelType mt,
+    value hint,
+    int num_models,
+    smt::solver& solver)
+{
+  ostringstream ss;
+  for (string const& so : module->sorts) {
+    ss << "sort " << so << "\n";
+  }
+  for (VarDecl decl : module->functions) {
+    ss << "function " << decl.to_string() << "\n";
+  }
+  for (value v : module->axioms) {
+    ss << "axiom " << v->to_string() << "\n";
+  }
+  ss << "label " << log_info << "\n";
+  ss << "models " << (mt == ModelType::Min ? "min " : "any ") << num_models << "\n";
+  if (hint) {
+    ss << "hint " << hint->to_string() << "\n";
+  }
+
+  ostringstream query;
+  solver.dump(query);
+  ss << normalize_names(query.str());
+
+  return hash128(ss.str());
+}
+
+static string entry_filename(string const& key) {
+  return smt_cache_dir + "/" + key + ".json";
+}
+
+bool smt_cache_lookup(
+    string const& key,
+    shared_ptr<Module> module,
+    ContextSolverResult& res)
+{
+  ifstream f(entry_filename(key));
+  if (!f.is_open()) {
+    smt::count_smt_cache_lookup(false);
+    return false;
+  }
+  stringstream buf;
+  buf << f.rdbuf();
+
+  string err;
+  Json j = Json::parse(buf.str(), err);
+  if (!err.empty() || !j.is_object()) {
+    smt::count_smt_cache_lookup(false);
+    return false;
+  }
+
+  res.models.clear();
+  if (j["res"].string_value() == "unsat") {
+    res.res = smt::SolverResult::Unsat;
+  } else {
+    assert(j["res"].string_value() == "sat");
+    res.res = smt::SolverResult::Sat;
+    for (Json const& m : j["models"].array_items()) {
+      res.models.push_back(Model::from_json(m, module));
+    }
+  }
+  smt::count_smt_cache_lookup(true);
+  return true;
+}
+
+void smt_cache_store(string const& key, ContextSolverResult const& res)
+{
+  if (res.res == smt::SolverResult::Unknown) {
+    return;
+  }
+
+  vector<Json> models;
+  for (shared_ptr<Model> m : res.models) {
+    models.push_back(m->to_json());
+  }
+  Json j = Json::object {
+    { "res", res.res == smt::SolverResult::Sat ? "sat" : "unsat" },
+    { "models", models },
+  };
+
+  string filename = entry_filename(key);
+  string tmp = filename + ".tmp." + to_string(getpid()) + "." + to_string(rand());
+  ofstream f(tmp);
+  f << j.dump();
+  f.close();
+  if (!f || rename(tmp.c_str(), filename.c_str()) != 0) {
+    remove(tmp.c_str());
+  }
+}
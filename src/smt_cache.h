@@ -0,0 +1,38 @@
+#ifndef SMT_CACHE_H
+#define SMT_CACHE_H
+
+#include "solve.h"
+
+#include <string>
+
+// On-disk cache of context_solve results, so that reruns of a benchmark
+// (and the processes of one run) don't solve the same query twice. Only
+// sat and unsat results are kept, along with the models of a sat one.
+//
+// A query is keyed by a 128-bit hash of the module, the query label, the
+// model type and hint, and the SMT-LIB text of the query with its generated
+// names (see name() in contexts.cpp) renumbered in order of appearance.
+// Each entry is a JSON file in the cache directory, written under a
+// temporary name and renamed into place, so that processes sharing the
+// directory never read a partial entry.
+
+// Cache directory; the cache is off if this is empty.
+extern std::string smt_cache_dir;
+
+std::string smt_cache_key(
+    std::shared_ptr<Module> module,
+    std::string const& log_info,
+    ModelType mt,
+    value hint,
+    int num_models,
+    smt::solver& solver);
+
+// Returns true and fills in `res` if `key` is in the cache
+bool smt_cache_lookup(
+    std::string const& key,
+    std::shared_ptr<Module> module,
+    ContextSolverResult& res);
+
+void smt_cache_store(std::string const& key, ContextSolverResult const& res);
+
+#endif
@@ -99,10 +99,17 @@ namespace smt_z3 {
 
   struct context : _context {
     z3::context ctx;
+    unsigned seed = 0;
 
     void set_timeout(int ms) override {
       ctx.set("timeout", ms);
     }
+    void set_seed(unsigned s) override {
+      seed = s;
+    }
+    void interrupt() override {
+      ctx.interrupt();
+    }
     std::shared_ptr<_sort> bool_sort() override {
       return shared_ptr<_sort>(new sort(ctx.bool_sort()));
     }
@@ -187,9 +194,17 @@ namespace smt_z3 {
 
   struct solver : _solver {
     z3::solver z3_solver;
-    solver(context& ctx) : z3_solver(ctx.ctx) { }
+    solver(context& ctx) : z3_solver(ctx.ctx) {
+      if (ctx.seed != 0) {
+        z3::params p(ctx.ctx);
+        p.set("random_seed", ctx.seed);
+        z3_solver.set(p);
+      }
+    }
 
     smt::SolverResult check_result() override;
+    smt::SolverResult check_result(_expr_vector* assumptions) override;
+    smt::SolverResult check(z3::expr_vector const* assumptions);
 
     void push() override { z3_solver.push(); }
     void pop() override { z3_solver.pop(); }
@@ -200,7 +215,7 @@ namespace smt_z3 {
       z3_solver.add(e->ex);
     }
 
-    void dump(ofstream&) override;
+    void dump(ostream&) override;
   };
 
   std::shared_ptr<_expr> func_decl::call(_expr_vector* _args) {
@@ -284,6 +299,30 @@ namespace smt {
 ////////////////////
 ///// Model stuff
 
+vector<int> Model::z3_domain_sizes(
+    smt::context& smt_ctx,
+    smt::solver& smt_solver,
+    vector<smt::sort> const& sorts)
+{
+  smt_z3::context& ctx = *dynamic_cast<smt_z3::context*>(smt_ctx.p.get());
+  smt_z3::solver& solver = *dynamic_cast<smt_z3::solver*>(smt_solver.p.get());
+
+  z3::model z3model = solver.z3_solver.get_model();
+
+  vector<int> sizes;
+  for (smt::sort const& so : sorts) {
+    z3::sort s = dynamic_cast<smt_z3::sort*>(so.p.get())->so;
+    Z3_ast_vector c_univ = Z3_model_get_sort_universe(ctx.ctx, z3model, s);
+    if (c_univ) {
+      z3::expr_vector univ(ctx.ctx, c_univ);
+      sizes.push_back(univ.size());
+    } else {
+      sizes.push_back(1);
+    }
+  }
+  return sizes;
+}
+
 shared_ptr<Model> Model::extract_z3(
     smt::context& smt_ctx,
     smt::solver& smt_solver,
@@ -498,11 +537,23 @@ namespace smt_z3 {
   }
 
   smt::SolverResult solver::check_result()
+  {
+    return check(nullptr);
+  }
+
+  smt::SolverResult solver::check_result(_expr_vector* _assumptions)
+  {
+    expr_vector* assumptions = dynamic_cast<expr_vector*>(_assumptions);
+    assert (assumptions != NULL);
+    return check(&assumptions->ex_vec);
+  }
+
+  smt::SolverResult solver::check(z3::expr_vector const* assumptions)
   {
     auto t1 = now();
     z3::check_result res;
     try {
-      res = z3_solver.check();
+      res = (assumptions ? z3_solver.check(*assumptions) : z3_solver.check());
     } catch (z3::exception exc) {
       cout << "got z3 exception" << endl;
       res = z3::unknown;
@@ -522,7 +573,7 @@ namespace smt_z3 {
     return smt::SolverResult::Unknown;
   }
 
-  void solver::dump(ofstream& of) {
+  void solver::dump(ostream& of) {
     of << z3_solver << endl;
   }
 
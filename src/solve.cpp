@@ -2,9 +2,14 @@
 
 #include <iostream>
 #include <cassert>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
 
 #include "stats.h"
 #include "benchmarking.h"
+#include "smt_cache.h"
 
 using namespace std;
 
@@ -16,11 +21,19 @@ smt::context _z3_ctx_quick;
 smt::context _cvc4_ctx_normal;
 smt::context _cvc4_ctx_quick;
 
+int smt_portfolio_size = 1;
+
+// Contexts for the portfolio; the one at index i seeds its solvers with i.
+static vector<smt::context> portfolio_ctxs_normal;
+static vector<smt::context> portfolio_ctxs_quick;
+
 void context_reset() {
   _z3_ctx_normal = smt::context();
   _z3_ctx_quick = smt::context();
   _cvc4_ctx_normal = smt::context();
   _cvc4_ctx_quick = smt::context();
+  portfolio_ctxs_normal.clear();
+  portfolio_ctxs_quick.clear();
 }
 
 smt::context z3_ctx_normal() {
@@ -55,6 +68,193 @@ smt::context cvc4_ctx_quick() {
   return _cvc4_ctx_quick;
 }
 
+static smt::context& portfolio_ctx(Strictness st, int i) {
+  vector<smt::context>& ctxs = (st == Strictness::Quick
+      ? portfolio_ctxs_quick : portfolio_ctxs_normal);
+  if ((int)ctxs.size() <= i) {
+    ctxs.resize(i + 1);
+  }
+  if (!ctxs[i].p) {
+    ctxs[i] = smt::context(smt::Backend::z3);
+    ctxs[i].set_timeout(st == Strictness::Quick ? 15000 : 45000);
+    ctxs[i].set_seed(i);
+  }
+  return ctxs[i];
+}
+
+static mutex portfolio_wins_mutex;
+static map<string, map<int, long long>> portfolio_wins;
+
+void dump_portfolio_stats() {
+  lock_guard<mutex> lock(portfolio_wins_mutex);
+  for (auto& p : portfolio_wins) {
+    for (auto& q : p.second) {
+      cout << "portfolio [" << p.first << "] seed " << q.first
+           << " won " << q.second << " times" << endl;
+    }
+  }
+}
+
+// context_solve shares the contexts above, so it runs one call at a time.
+static mutex context_solve_mutex;
+
+// Contexts with a check in progress, by the cancel flag of that check, so
+// that interrupt_running_checks() reaches only the checks the flag belongs
+// to, and only once they exist.
+static mutex running_checks_mutex;
+static multimap<atomic<bool> const*, smt::context> running_checks;
+
+static void set_running_check(atomic<bool> const* cancelled, smt::context ctx) {
+  if (cancelled) {
+    lock_guard<mutex> lock(running_checks_mutex);
+    running_checks.insert(make_pair(cancelled, ctx));
+  }
+}
+
+static void clear_running_check(atomic<bool> const* cancelled, smt::context ctx) {
+  if (cancelled) {
+    lock_guard<mutex> lock(running_checks_mutex);
+    auto range = running_checks.equal_range(cancelled);
+    for (auto it = range.first; it != range.second; ++it) {
+      if (it->second.p == ctx.p) {
+        running_checks.erase(it);
+        break;
+      }
+    }
+  }
+}
+
+static void interrupt_running_checks(atomic<bool> const& cancelled) {
+  lock_guard<mutex> lock(running_checks_mutex);
+  auto range = running_checks.equal_range(&cancelled);
+  for (auto it = range.first; it != range.second; ++it) {
+    it->second.interrupt();
+  }
+}
+
+// Checks the query built by `f` on every portfolio context at once and takes
+// the first sat or unsat answer, interrupting the others. Returns unknown if
+// none gives one. If `bgc` is set on entry, it and `es` are used as the
+// query on the first context. On return they are set to those of the
+// context that answered. context_solve uses it in place of the z3 context, so retries
+// still alternate with cvc4.
+static smt::SolverResult portfolio_check(
+    std::string const& log_info,
+    std::shared_ptr<Module> module,
+    Strictness st,
+    std::function<
+        std::vector<std::shared_ptr<ModelEmbedding>>(std::shared_ptr<BackgroundContext>)
+      > const& f,
+    std::atomic<bool> const* cancelled,
+    shared_ptr<BackgroundContext>& bgc,
+    vector<shared_ptr<ModelEmbedding>>& es)
+{
+  int n = smt_portfolio_size;
+  vector<smt::context> ctxs;
+  vector<shared_ptr<BackgroundContext>> bgcs;
+  vector<vector<shared_ptr<ModelEmbedding>>> ess;
+  for (int i = 0; i < n; i++) {
+    ctxs.push_back(portfolio_ctx(st, i));
+    if (i == 0 && bgc) {
+      bgcs.push_back(bgc);
+      ess.push_back(es);
+    } else {
+      bgcs.push_back(shared_ptr<BackgroundContext>(
+          new BackgroundContext(ctxs[i], module)));
+      ess.push_back(f(bgcs[i]));
+    }
+    bgcs[i]->solver.set_log_info(log_info);
+  }
+  bgc = bgcs[0];
+  es = ess[0];
+
+  for (smt::context& ctx : ctxs) {
+    set_running_check(cancelled, ctx);
+  }
+
+  struct Slot {
+    smt::SolverResult res;
+    bool done = false;
+    smt::SmtStats stats;
+  };
+  vector<Slot> slots(n);
+  mutex m;
+  condition_variable cv;
+
+  vector<thread> threads;
+  for (int i = 0; i < n; i++) {
+    threads.push_back(thread([&, i]() {
+      smt::SolverResult r = (cancelled && *cancelled)
+          ? smt::SolverResult::Unknown : bgcs[i]->solver.check_result();
+      smt::SmtStats stats = smt::take_smt_stats();
+      lock_guard<mutex> lock(m);
+      slots[i].res = r;
+      slots[i].stats = move(stats);
+      slots[i].done = true;
+      cv.notify_all();
+    }));
+  }
+
+  int winner = -1;
+  {
+    unique_lock<mutex> lock(m);
+    while (true) {
+      int num_done = 0;
+      for (int i = 0; i < n; i++) {
+        if (slots[i].done) {
+          num_done++;
+          if (winner == -1 && slots[i].res != smt::SolverResult::Unknown) {
+            winner = i;
+          }
+        }
+      }
+      if (winner != -1 || num_done == n) {
+        break;
+      }
+      cv.wait(lock);
+    }
+
+    // Z3 drops an interrupt that comes before the check has started, so
+    // keep sending it until every check is over. One that comes just after
+    // a check is over only fails a push or get_model on that context before
+    // its next check, and the next use of a portfolio context starts with
+    // a new solver and a check.
+    while (true) {
+      bool all_done = true;
+      for (int i = 0; i < n; i++) {
+        if (!slots[i].done) {
+          ctxs[i].interrupt();
+          all_done = false;
+        }
+      }
+      if (all_done) {
+        break;
+      }
+      cv.wait_for(lock, chrono::milliseconds(10));
+    }
+  }
+
+  for (int i = 0; i < n; i++) {
+    threads[i].join();
+    smt::add_smt_stats(slots[i].stats);
+  }
+
+  for (smt::context& ctx : ctxs) {
+    clear_running_check(cancelled, ctx);
+  }
+
+  if (winner == -1) {
+    return smt::SolverResult::Unknown;
+  }
+
+  {
+    lock_guard<mutex> lock(portfolio_wins_mutex);
+    portfolio_wins[log_info][winner]++;
+  }
+  bgc = bgcs[winner];
+  es = ess[winner];
+  return slots[winner].res;
+}
 
 ContextSolverResult context_solve(
     std::string const& log_info,
@@ -64,22 +264,68 @@ ContextSolverResult context_solve(
     value hint,
     std::function<
         std::vector<std::shared_ptr<ModelEmbedding>>(std::shared_ptr<BackgroundContext>)
-      > f)
+      > f,
+    std::atomic<bool> const* cancelled)
 {
+  lock_guard<mutex> lock(context_solve_mutex);
+
   auto t1 = now();
 
+  // With the cache on, the query for the first attempt is built up front
+  // to compute the key, and reused for that attempt on a miss.
+  shared_ptr<BackgroundContext> first_bgc;
+  vector<shared_ptr<ModelEmbedding>> first_es;
+  string cache_key;
+  if (!smt_cache_dir.empty()) {
+    smt::context ctx = (smt_portfolio_size > 1 ? portfolio_ctx(st, 0)
+        : (st == Strictness::Quick ? z3_ctx_quick() : z3_ctx_normal()));
+    first_bgc.reset(new BackgroundContext(ctx, module));
+    first_es = f(first_bgc);
+    cache_key = smt_cache_key(module, log_info, mt, hint, first_es.size(), first_bgc->solver);
+
+    ContextSolverResult csr;
+    if (smt_cache_lookup(cache_key, module, csr)) {
+      global_stats.add_total(as_ms(now() - t1));
+      return csr;
+    }
+  }
+
   int num_fails = 0; 
   while (true) {
-    smt::context ctx = (num_fails % 2 == 0
-        ? (st == Strictness::Quick ? z3_ctx_quick() : z3_ctx_normal())
-        : (st == Strictness::Quick ? cvc4_ctx_quick() : cvc4_ctx_normal())
-    );
+    if (cancelled && *cancelled) {
+      ContextSolverResult csr;
+      csr.res = smt::SolverResult::Unknown;
+      return csr;
+    }
+
     shared_ptr<BackgroundContext> bgc;
-    bgc.reset(new BackgroundContext(ctx, module));
-    vector<shared_ptr<ModelEmbedding>> es = f(bgc);
+    vector<shared_ptr<ModelEmbedding>> es;
+    if (num_fails == 0) {
+      bgc = first_bgc;
+      es = first_es;
+    }
+    smt::SolverResult res;
+    if (smt_portfolio_size > 1 && num_fails % 2 == 0) {
+      res = portfolio_check(log_info, module, st, f, cancelled, bgc, es);
+    } else {
+      smt::context ctx = (num_fails % 2 == 0
+          ? (st == Strictness::Quick ? z3_ctx_quick() : z3_ctx_normal())
+          : (st == Strictness::Quick ? cvc4_ctx_quick() : cvc4_ctx_normal())
+      );
+      if (!bgc) {
+        bgc.reset(new BackgroundContext(ctx, module));
+        es = f(bgc);
+      }
 
-    bgc->solver.set_log_info(log_info);
-    smt::SolverResult res = bgc->solver.check_result();
+      bgc->solver.set_log_info(log_info);
+      set_running_check(cancelled, ctx);
+      res = (cancelled && *cancelled)
+          ? smt::SolverResult::Unknown : bgc->solver.check_result();
+      clear_running_check(cancelled, ctx);
+    }
+    if (cancelled && *cancelled) {
+      continue;
+    }
 
     if (
          st == Strictness::Indef
@@ -119,6 +365,10 @@ ContextSolverResult context_solve(
         numTryHardFailures++;
       }
 
+      if (!cache_key.empty()) {
+        smt_cache_store(cache_key, csr);
+      }
+
       return csr;
     }
 
@@ -128,3 +378,326 @@ ContextSolverResult context_solve(
     cout << "failure encountered, retrying" << endl;
   }
 }
+
+// Solver for one action's transition relation, kept across queries.
+// The invariants and each query are asserted under boolean literals of
+// their own and turned on by assuming those literals in the check, rather
+// than with push and pop: an interrupt that reaches Z3 just after a check
+// has returned makes the next push on that context fail, while add and
+// check are unaffected. A query's literal is turned off for good after it.
+struct IncrementalInductionSolver {
+  smt::context ctx;
+  std::shared_ptr<InductionContext> indctx;
+  int num_guards = 0;
+  int num_queries = 0;
+
+  // Literal for each invariant asserted so far, by its string
+  map<string, smt::expr> invariant_guard;
+  // The invariants of the last query, with their literals
+  vector<value> invariants;
+  vector<smt::expr> invariant_guards;
+
+  IncrementalInductionSolver(shared_ptr<Module> module, int action_idx)
+    : ctx(smt::Backend::z3)
+  {
+    ctx.set_timeout(45000);
+    indctx.reset(new InductionContext(ctx, module, action_idx));
+  }
+
+  smt::expr new_guard() {
+    return ctx.var("guard__" + to_string(num_guards++), ctx.bool_sort());
+  }
+
+  void set_invariants(vector<value> const& invs) {
+    bool extends = invs.size() >= invariants.size();
+    for (int i = 0; extends && i < (int)invariants.size(); i++) {
+      extends = (invs[i] == invariants[i]);
+    }
+    if (!extends) {
+      invariants.clear();
+      invariant_guards.clear();
+    }
+    for (int i = invariants.size(); i < (int)invs.size(); i++) {
+      string key = invs[i]->to_string();
+      auto it = invariant_guard.find(key);
+      if (it == invariant_guard.end()) {
+        smt::expr g = new_guard();
+        indctx->ctx->solver.add(
+            smt::implies(g, indctx->e1->value2expr(invs[i])));
+        it = invariant_guard.insert(make_pair(key, g)).first;
+      }
+      invariants.push_back(invs[i]);
+      invariant_guards.push_back(it->second);
+    }
+  }
+};
+
+// A solver is built again after this many queries, so that the ones
+// turned off don't pile up.
+static const int max_incremental_induction_queries = 1000;
+
+// Idle solvers by (module, action). A query takes one, or builds one if
+// all are in use by concurrent checks, and puts it back when done.
+static mutex incremental_induction_solvers_mutex;
+static map<pair<Module*, int>, vector<shared_ptr<IncrementalInductionSolver>>>
+    idle_incremental_induction_solvers;
+
+static shared_ptr<IncrementalInductionSolver> take_incremental_induction_solver(
+    shared_ptr<Module> module, int action_idx)
+{
+  {
+    lock_guard<mutex> lock(incremental_induction_solvers_mutex);
+    vector<shared_ptr<IncrementalInductionSolver>>& idle =
+        idle_incremental_induction_solvers[make_pair(module.get(), action_idx)];
+    if (!idle.empty()) {
+      shared_ptr<IncrementalInductionSolver> iis = idle.back();
+      idle.pop_back();
+      return iis;
+    }
+  }
+  return shared_ptr<IncrementalInductionSolver>(
+      new IncrementalInductionSolver(module, action_idx));
+}
+
+static void put_back_incremental_induction_solver(
+    shared_ptr<Module> module, int action_idx,
+    shared_ptr<IncrementalInductionSolver> iis)
+{
+  if (iis->num_queries >= max_incremental_induction_queries) {
+    return;
+  }
+  lock_guard<mutex> lock(incremental_induction_solvers_mutex);
+  idle_incremental_induction_solvers[make_pair(module.get(), action_idx)]
+      .push_back(iis);
+}
+
+ContextSolverResult incremental_induction_solve(
+    std::string const& log_info,
+    std::shared_ptr<Module> module,
+    int action_idx,
+    ModelType mt,
+    Strictness st,
+    value hint,
+    int num_models,
+    std::vector<value> const& invariants,
+    std::function<smt::expr(InductionContext&)> f,
+    std::atomic<bool> const* cancelled)
+{
+  auto t1 = now();
+
+  ContextSolverResult csr;
+  csr.res = smt::SolverResult::Unknown;
+  if (cancelled && *cancelled) {
+    return csr;
+  }
+
+  shared_ptr<IncrementalInductionSolver> iis =
+      take_incremental_induction_solver(module, action_idx);
+  iis->set_invariants(invariants);
+
+  InductionContext& indctx = *iis->indctx;
+  smt::solver& solver = indctx.ctx->solver;
+  smt::expr query = iis->new_guard();
+  solver.add(smt::implies(query, f(indctx)));
+  iis->num_queries++;
+
+  smt::expr_vector assumptions(iis->ctx);
+  for (smt::expr g : iis->invariant_guards) {
+    assumptions.push_back(g);
+  }
+  assumptions.push_back(query);
+
+  solver.set_log_info(log_info);
+  set_running_check(cancelled, iis->ctx);
+  smt::SolverResult res = (cancelled && *cancelled)
+      ? smt::SolverResult::Unknown : solver.check_result(assumptions);
+  clear_running_check(cancelled, iis->ctx);
+  if (cancelled && *cancelled) {
+    res = smt::SolverResult::Unknown;
+  }
+
+  csr.res = res;
+  if (res == smt::SolverResult::Sat) {
+    // Model extraction checks again without the assumptions.
+    solver.push();
+    for (int i = 0; i < (int)assumptions.size(); i++) {
+      solver.add(assumptions[i]);
+    }
+
+    vector<shared_ptr<ModelEmbedding>> es = {indctx.e1, indctx.e2};
+    es.resize(num_models);
+    if (mt == ModelType::Any) {
+      for (int i = 0; i < (int)es.size(); i++) {
+        csr.models.push_back(Model::extract_model_from_z3(
+            indctx.ctx->ctx, solver, module, *es[i]));
+      }
+      csr.models[0]->dump_sizes();
+    } else {
+      auto t1 = now();
+
+      csr.models = Model::extract_minimal_models_from_z3(
+          indctx.ctx->ctx, solver, module, es, hint);
+
+      auto t2 = now();
+      long long ms = as_ms(t2 - t1);
+      global_stats.add_model_min(ms);
+    }
+
+    solver.pop();
+  }
+  solver.add(!query);
+  put_back_incremental_induction_solver(module, action_idx, iis);
+
+  if (res != smt::SolverResult::Unknown
+      || st == Strictness::Indef || st == Strictness::Quick
+      || (cancelled && *cancelled)) {
+    long long ms = as_ms(now() - t1);
+    global_stats.add_total(ms);
+    return csr;
+  }
+
+  return context_solve(log_info, module, mt, st, hint,
+      [module, action_idx, num_models, &invariants, &f](
+          shared_ptr<BackgroundContext> bgctx)
+  {
+    auto indctx = shared_ptr<InductionContext>(
+        new InductionContext(bgctx, module, action_idx));
+    for (value inv : invariants) {
+      indctx->ctx->solver.add(indctx->e1->value2expr(inv));
+    }
+    indctx->ctx->solver.add(f(*indctx));
+    vector<shared_ptr<ModelEmbedding>> es = {indctx->e1, indctx->e2};
+    es.resize(num_models);
+    return es;
+  }, cancelled);
+}
+
+OrderedCheck incremental_induction_check(
+    std::string const& log_info,
+    std::shared_ptr<Module> module,
+    int action_idx,
+    ModelType mt,
+    Strictness st,
+    value hint,
+    int num_models,
+    std::vector<value> const& invariants,
+    std::function<smt::expr(InductionContext&)> f)
+{
+  return [=](atomic<bool> const& cancelled) {
+    return incremental_induction_solve(log_info, module, action_idx, mt, st,
+        hint, num_models, invariants, f, &cancelled);
+  };
+}
+
+static bool finished_unsat(ContextSolverResult const& res) {
+  return res.res == smt::SolverResult::Unsat;
+}
+
+int solve_in_order(
+    std::vector<OrderedCheck> const& checks,
+    bool concurrent,
+    ContextSolverResult& res)
+{
+  int n = checks.size();
+  if (!concurrent || n <= 1) {
+    atomic<bool> never(false);
+    for (int i = 0; i < n; i++) {
+      res = checks[i](never);
+      if (!finished_unsat(res)) {
+        return i;
+      }
+    }
+    return -1;
+  }
+
+  struct Slot {
+    ContextSolverResult res;
+    bool done = false;
+    atomic<bool> cancelled;
+    smt::SmtStats stats;
+    Slot() : cancelled(false) { }
+  };
+  vector<Slot> slots(n);
+  mutex m;
+  condition_variable cv;
+
+  // Z3 drops an interrupt that comes before the check has started, so the
+  // cancelled checks are interrupted again each time round until they end.
+  auto cancel = [&](int i) {
+    slots[i].cancelled = true;
+    interrupt_running_checks(slots[i].cancelled);
+  };
+  auto interrupt_cancelled = [&]() {
+    bool all_done = true;
+    for (int i = 0; i < n; i++) {
+      if (!slots[i].done) {
+        if (slots[i].cancelled) {
+          interrupt_running_checks(slots[i].cancelled);
+        }
+        all_done = false;
+      }
+    }
+    return all_done;
+  };
+
+  vector<thread> threads;
+  for (int i = 0; i < n; i++) {
+    threads.push_back(thread([&, i]() {
+      ContextSolverResult r = checks[i](slots[i].cancelled);
+      smt::SmtStats stats = smt::take_smt_stats();
+      lock_guard<mutex> lock(m);
+      slots[i].res = move(r);
+      slots[i].stats = move(stats);
+      slots[i].done = true;
+      cv.notify_all();
+    }));
+  }
+
+  // The answer is the first check, in order, that isn't Unsat. Once some
+  // check comes back non-Unsat, nothing after it can matter.
+  int winner;
+  int cancelled_from = n;
+  {
+    unique_lock<mutex> lock(m);
+    while (true) {
+      int k = 0;
+      while (k < n && slots[k].done && finished_unsat(slots[k].res)) {
+        k++;
+      }
+      if (k == n || slots[k].done) {
+        winner = (k == n ? -1 : k);
+        break;
+      }
+
+      for (int i = k + 1; i < cancelled_from; i++) {
+        if (slots[i].done && !finished_unsat(slots[i].res)) {
+          for (int j = i + 1; j < cancelled_from; j++) {
+            cancel(j);
+          }
+          cancelled_from = i + 1;
+          break;
+        }
+      }
+
+      interrupt_cancelled();
+      cv.wait_for(lock, chrono::milliseconds(10));
+    }
+
+    for (int j = (winner == -1 ? n : winner + 1); j < cancelled_from; j++) {
+      cancel(j);
+    }
+    while (!interrupt_cancelled()) {
+      cv.wait_for(lock, chrono::milliseconds(10));
+    }
+  }
+
+  for (int i = 0; i < n; i++) {
+    threads[i].join();
+    smt::add_smt_stats(slots[i].stats);
+  }
+
+  if (winner != -1) {
+    res = move(slots[winner].res);
+  }
+  return winner;
+}
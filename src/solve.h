@@ -4,6 +4,7 @@
 #include "model.h"
 #include "smt.h"
 #include <functional>
+#include <atomic>
 
 struct ContextSolverResult {
   smt::SolverResult res;
@@ -22,6 +23,8 @@ enum class Strictness {
   TryHard
 };
 
+// context_solve uses one set of shared contexts, so calls from different
+// threads run one at a time.
 ContextSolverResult context_solve(
     std::string const& log_info,
     std::shared_ptr<Module> module,
@@ -30,8 +33,67 @@ ContextSolverResult context_solve(
     value hint,
     std::function<
         std::vector<std::shared_ptr<ModelEmbedding>>(std::shared_ptr<BackgroundContext>)
-      > f);
+      > f,
+    std::atomic<bool> const* cancelled = nullptr);
+
+// Like context_solve, but for a query on the transition relation of action
+// `action_idx`. Each action keeps long-lived solvers that already hold the
+// axioms and the transition relation, one for each query running at the
+// same time. The `invariants` are asserted on the pre-state and kept for
+// later calls. `f` gives the rest of the query, which holds for this call
+// only. The models returned are those of the pre-state and, if `num_models`
+// is 2, the post-state.
+//
+// If the incremental solver returns unknown, the query is retried through
+// context_solve from scratch.
+ContextSolverResult incremental_induction_solve(
+    std::string const& log_info,
+    std::shared_ptr<Module> module,
+    int action_idx,
+    ModelType mt,
+    Strictness,
+    value hint,
+    int num_models,
+    std::vector<value> const& invariants,
+    std::function<smt::expr(InductionContext&)> f,
+    std::atomic<bool> const* cancelled = nullptr);
+
+// A check for solve_in_order. It should give up (returning unknown) once
+// `cancelled` is set, and any context_solve or incremental_induction_solve
+// it makes should be passed that flag, so it can be interrupted mid-check.
+typedef std::function<ContextSolverResult(std::atomic<bool> const& cancelled)>
+    OrderedCheck;
+
+// An OrderedCheck running incremental_induction_solve for `action_idx`
+OrderedCheck incremental_induction_check(
+    std::string const& log_info,
+    std::shared_ptr<Module> module,
+    int action_idx,
+    ModelType mt,
+    Strictness,
+    value hint,
+    int num_models,
+    std::vector<value> const& invariants,
+    std::function<smt::expr(InductionContext&)> f);
+
+// Runs `checks` until one is not unsat, and returns its index (or -1 if
+// they all are), with its result in `res`. With `concurrent`, all of them
+// start at once on threads of their own, and the ones after a result that is
+// not unsat are cancelled; the outcome is still that of running them in order.
+// Only checks made with incremental_induction_solve actually overlap, since
+// context_solve serialises its callers.
+int solve_in_order(
+    std::vector<OrderedCheck> const& checks,
+    bool concurrent,
+    ContextSolverResult& res);
 
 void context_reset();
 
+// With more than 1, context_solve races this many differently seeded Z3
+// solvers on each query and takes the first sat or unsat answer.
+extern int smt_portfolio_size;
+
+// How often each seed answered first, per query label
+void dump_portfolio_stats();
+
 #endif
@@ -4,17 +4,24 @@
 #include <vector>
 #include <string>
 #include <fstream>
+#include <mutex>
 
 struct Stats {
   std::vector<long long> z3_times;
   std::vector<long long> cvc4_times;
   std::vector<long long> total_times;
   std::vector<long long> model_min_times;
+  std::mutex m;
 
-  void add_z3(long long a) { z3_times.push_back(a); }
-  void add_cvc4(long long a) { cvc4_times.push_back(a); }
-  void add_total(long long a) { total_times.push_back(a); }
-  void add_model_min(long long a) { model_min_times.push_back(a); }
+  void add_z3(long long a) { add(z3_times, a); }
+  void add_cvc4(long long a) { add(cvc4_times, a); }
+  void add_total(long long a) { add(total_times, a); }
+  void add_model_min(long long a) { add(model_min_times, a); }
+
+  void add(std::vector<long long>& vec, long long a) {
+    std::lock_guard<std::mutex> lock(m);
+    vec.push_back(a);
+  }
 
   void dump_vec(std::ofstream& f, std::string const& name,
       std::vector<long long> const& vec)
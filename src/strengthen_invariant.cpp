@@ -50,7 +50,7 @@ value strengthen_invariant_once(
   TopAlternatingQuantifierDesc taqd(new_invariant);
   value body = TopAlternatingQuantifierDesc::get_body(new_invariant);
 
-  Or* disj = dynamic_cast<Or*>(body.get());
+  Or* disj = value_cast<Or>(body.get());
   if (!disj) {
     return new_invariant;
   }
@@ -73,7 +73,7 @@ value strengthen_invariant_once(
 
   for (int i = 0; i < (int)args.size(); i++) {
     //cout << "i = " << i << endl;
-    if (And* a = dynamic_cast<And*>(args[i].get())) {
+    if (And* a = value_cast<And>(args[i].get())) {
       for (int j = 0; j < (int)a->args.size(); j++) {
         //cout << "j = " << j << endl;
         vector<value> new_conj = remove(a->args, j);
@@ -84,7 +84,7 @@ value strengthen_invariant_once(
             && is_invariant_wrt_tryhard(module, invariant_so_far, inv1)) {
           //cout << "is inv (and implies)" << endl << endl;
           args = new_args;
-          a = dynamic_cast<And*>(args[i].get());
+          a = value_cast<And>(args[i].get());
           if (a == NULL) {
             break;
           }
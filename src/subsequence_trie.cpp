@@ -0,0 +1,167 @@
+#include "subsequence_trie.h"
+
+#include <algorithm>
+#include <cassert>
+
+using namespace std;
+
+atomic<long long> subsequence_trie_bytes(0);
+
+SubsequenceTrie::SubsequenceTrie(int alpha)
+  : alphabet_size(alpha), is_term(1, false), edges(16, Edge{0, -1}),
+    num_edges(0), accounted(0)
+{
+  account();
+}
+
+SubsequenceTrie::~SubsequenceTrie() {
+  subsequence_trie_bytes -= accounted;
+}
+
+SubsequenceTrie::SubsequenceTrie(SubsequenceTrie&& other)
+  : alphabet_size(other.alphabet_size), is_term(move(other.is_term)),
+    edges(move(other.edges)), num_edges(other.num_edges),
+    accounted(other.accounted)
+{
+  other.accounted = 0;
+}
+
+SubsequenceTrie& SubsequenceTrie::operator=(SubsequenceTrie&& other) {
+  if (this != &other) {
+    subsequence_trie_bytes -= accounted;
+    alphabet_size = other.alphabet_size;
+    is_term = move(other.is_term);
+    edges = move(other.edges);
+    num_edges = other.num_edges;
+    accounted = other.accounted;
+    other.accounted = 0;
+  }
+  return *this;
+}
+
+void SubsequenceTrie::insert(vector<int> const& s) {
+  int node = 0;
+  for (int i = 0; i < (int)s.size(); i++) {
+    assert(0 <= s[i] && s[i] < alphabet_size);
+    int c = get_child(node, s[i]);
+    node = (c != -1 ? c : add_child(node, s[i]));
+  }
+  is_term[node] = true;
+  account();
+}
+
+int SubsequenceTrie::add_child(int node, int sym) {
+  if (2 * (num_edges + 1) > (int)edges.size()) {
+    grow_edges();
+  }
+  int c = is_term.size();
+  is_term.push_back(false);
+
+  uint64_t key = edge_key(node, sym);
+  size_t mask = edges.size() - 1;
+  size_t i = slot_of(key);
+  while (edges[i].child != -1) {
+    i = (i + 1) & mask;
+  }
+  edges[i].key = key;
+  edges[i].child = c;
+  num_edges++;
+  return c;
+}
+
+void SubsequenceTrie::grow_edges() {
+  vector<Edge> old = move(edges);
+  edges = vector<Edge>(old.size() * 2, Edge{0, -1});
+  size_t mask = edges.size() - 1;
+  for (Edge const& e : old) {
+    if (e.child != -1) {
+      size_t i = slot_of(e.key);
+      while (edges[i].child != -1) {
+        i = (i + 1) & mask;
+      }
+      edges[i] = e;
+    }
+  }
+}
+
+long long SubsequenceTrie::bytes() const {
+  return (long long)(is_term.capacity() * sizeof(char)
+      + edges.capacity() * sizeof(Edge));
+}
+
+void SubsequenceTrie::account() {
+  long long b = bytes();
+  subsequence_trie_bytes += b - accounted;
+  accounted = b;
+}
+
+SubsetBitsetIndex::SubsetBitsetIndex(int alpha)
+  : num_sets(0), has_empty(false), containing(alpha)
+{
+}
+
+void SubsetBitsetIndex::insert(vector<int> const& s0) {
+  vector<int> s = s0;
+  sort(s.begin(), s.end());
+  s.erase(unique(s.begin(), s.end()), s.end());
+  if (s.empty()) {
+    has_empty = true;
+    return;
+  }
+
+  int i = num_sets++;
+  int words = (num_sets + 63) / 64;
+  int m = s.size();
+  while ((1 << size_planes.size()) <= m) {
+    size_planes.push_back(vector<uint64_t>(words, 0));
+  }
+  for (int b = 0; b < (int)size_planes.size(); b++) {
+    size_planes[b].resize(words, 0);
+    if ((m >> b) & 1) {
+      size_planes[b][i / 64] |= (uint64_t)1 << (i % 64);
+    }
+  }
+
+  for (int q : s) {
+    assert(0 <= q && q < (int)containing.size());
+    containing[q].resize(words, 0);
+    containing[q][i / 64] |= (uint64_t)1 << (i % 64);
+  }
+}
+
+bool SubsetBitsetIndex::query(vector<int> const& t, int& upTo) {
+  if (has_empty) {
+    upTo = 0;
+    return true;
+  }
+
+  int planes = size_planes.size();
+  int words = (num_sets + 63) / 64;
+  count_planes.resize(planes);
+  for (int b = 0; b < planes; b++) {
+    count_planes[b].assign(words, 0);
+  }
+
+  for (int p = 0; p < (int)t.size(); p++) {
+    // Only the sets containing t[p] change count, so only they can have
+    // just become complete.
+    vector<uint64_t> const& row = containing[t[p]];
+    for (int w = 0; w < (int)row.size(); w++) {
+      uint64_t carry = row[w];
+      if (carry == 0) continue;
+      uint64_t complete = carry;
+      for (int b = 0; b < planes; b++) {
+        uint64_t c = count_planes[b][w];
+        count_planes[b][w] = c ^ carry;
+        carry &= c;
+        complete &= ~(count_planes[b][w] ^ size_planes[b][w]);
+      }
+      if (complete != 0) {
+        upTo = p + 1;
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
@@ -2,7 +2,9 @@
 #define SUBSEQUENCE_TRIE_H
 
 #include <vector>
-#include <memory>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 
 // Stores a set S of sequences
 // Supports the query: given a sequence t, does there exist subsequence s in S
@@ -11,64 +13,120 @@
 // Query is exponential in t.size(), but we expect to use this where t.size()
 // is around 5.
 
-struct TrieNode {
-  std::vector<std::unique_ptr<TrieNode>> children;
-  bool isTerm;
+// Nodes are numbered from 0 (the root). Every edge of the trie lives in one
+// open-addressing table keyed by (node, symbol), so a node costs a byte plus
+// its in-edge rather than a child array over the whole alphabet.
+class SubsequenceTrie {
+public:
+  SubsequenceTrie() : SubsequenceTrie(0) { }
+  SubsequenceTrie(int alpha);
+  ~SubsequenceTrie();
 
-  TrieNode(int n) {
-    children.resize(n);
-    isTerm = false;
-  }
-};
-
-inline bool subseq_query(std::vector<int> const& t, int idx, TrieNode* node, int& upTo) {
-  if (node->isTerm) {
-    upTo = idx;
-    return true;
-  }
+  SubsequenceTrie(SubsequenceTrie&& other);
+  SubsequenceTrie& operator=(SubsequenceTrie&& other);
+  SubsequenceTrie(SubsequenceTrie const&) = delete;
+  SubsequenceTrie& operator=(SubsequenceTrie const&) = delete;
 
-  if (idx == (int)t.size()) {
-    return false;
-  }
+  void insert(std::vector<int> const& s);
 
-  if (subseq_query(t, idx + 1, node, upTo)) {
-    return true;
+  // Determine if a subsequence of t exists in s
+  bool query(std::vector<int> const& t, int& upTo) const {
+    return query(t, 0, 0, upTo);
   }
 
-  if (node->children[t[idx]] != nullptr) {
-    return subseq_query(t, idx + 1, node->children[t[idx]].get(), upTo);
-  }
+  // Bytes held by the node and edge tables
+  long long bytes() const;
 
-  return false;
-}
+private:
+  struct Edge {
+    uint64_t key;
+    int child; // -1 if the slot is empty
+  };
 
-struct SubsequenceTrie {
-  std::unique_ptr<TrieNode> root;
   int alphabet_size;
+  std::vector<char> is_term;
+  std::vector<Edge> edges;
+  int num_edges;
 
-  SubsequenceTrie() { }
+  // bytes() as of the last update to subsequence_trie_bytes
+  long long accounted;
 
-  SubsequenceTrie(int alpha) {
-    alphabet_size = alpha;
-    root = std::unique_ptr<TrieNode>(new TrieNode(alpha));
+  static uint64_t edge_key(int node, int sym) {
+    return ((uint64_t)node << 32) | (uint32_t)sym;
+  }
+  size_t slot_of(uint64_t key) const {
+    return ((key * 0x9e3779b97f4a7c15ULL) >> 32) & (edges.size() - 1);
   }
 
-  void insert(std::vector<int> const& s) {
-    TrieNode* node = root.get();
-    for (int i = 0; i < (int)s.size(); i++) {
-      int j = s[i];
-      if (node->children[j] == nullptr) {
-        node->children[j] = std::unique_ptr<TrieNode>(new TrieNode(alphabet_size));
+  int get_child(int node, int sym) const {
+    uint64_t key = edge_key(node, sym);
+    size_t mask = edges.size() - 1;
+    for (size_t i = slot_of(key); edges[i].child != -1; i = (i + 1) & mask) {
+      if (edges[i].key == key) {
+        return edges[i].child;
       }
-      node = node->children[j].get();
     }
-    node->isTerm = true;
+    return -1;
   }
 
-  // Determine if a subsequence of t exists in s
-  bool query(std::vector<int> const& t, int& upTo) {
-    return subseq_query(t, 0, root.get(), upTo);
+  bool query(std::vector<int> const& t, int idx, int node, int& upTo) const {
+    if (is_term[node]) {
+      upTo = idx;
+      return true;
+    }
+
+    if (idx == (int)t.size()) {
+      return false;
+    }
+
+    if (query(t, idx + 1, node, upTo)) {
+      return true;
+    }
+
+    int c = get_child(node, t[idx]);
+    if (c != -1) {
+      return query(t, idx + 1, c, upTo);
+    }
+
+    return false;
   }
+
+  int add_child(int node, int sym);
+  void grow_edges();
+  void account();
+};
+
+// Answers the same query as SubsequenceTrie for sorted sequences, treating
+// stored sequences as sets: is some stored set contained in t? For each
+// symbol it keeps a bitset of the stored sets containing it, and a query
+// runs a bit-sliced counter of how many of each set's symbols it has seen.
+// Cost is linear in t.size() and the number of stored sets, rather than
+// exponential in t.size(). upTo is the shortest prefix of t that contains a
+// stored set. The elements of t must be distinct.
+class SubsetBitsetIndex {
+public:
+  SubsetBitsetIndex() : SubsetBitsetIndex(0) { }
+  SubsetBitsetIndex(int alpha);
+
+  void insert(std::vector<int> const& s);
+
+  bool query(std::vector<int> const& t, int& upTo);
+
+private:
+  int num_sets;
+  bool has_empty;
+
+  // containing[q] has bit i set if stored set i contains q
+  std::vector<std::vector<uint64_t>> containing;
+
+  // size_planes[b] has bit i set if bit b of |set i| is set
+  std::vector<std::vector<uint64_t>> size_planes;
+
+  // scratch for query(): bit b of the per-set counts
+  std::vector<std::vector<uint64_t>> count_planes;
 };
 
+// Total bytes() over all live tries, for the stats
+extern std::atomic<long long> subsequence_trie_bytes;
+
 #endif
@@ -3,13 +3,71 @@
 #include <cassert>
 #include <vector>
 #include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #include "enumerator.h"
 #include "alt_synth_enumerator.h"
 #include "alt_depth2_synth_enumerator.h"
+#include "model_isomorphisms.h"
 
 using namespace std;
 
+static void add_kill_counts(vector<long long>& total, vector<long long> const& kills)
+{
+  if (total.size() < kills.size()) {
+    total.resize(kills.size());
+  }
+  for (int i = 0; i < (int)kills.size(); i++) {
+    total[i] += kills[i];
+  }
+}
+
+static uint64_t cex_hash(Counterexample const& cex)
+{
+  if (cex.is_true) {
+    return model_canonical_hash(cex.is_true) * 3 + 0;
+  } else if (cex.is_false) {
+    return model_canonical_hash(cex.is_false) * 3 + 1;
+  } else {
+    return (model_canonical_hash(cex.hypothesis) * 31
+        + model_canonical_hash(cex.conclusion)) * 3 + 2;
+  }
+}
+
+static bool are_cexes_isomorphic(Counterexample const& a, Counterexample const& b)
+{
+  if (a.is_true) {
+    return b.is_true && are_models_isomorphic(a.is_true, b.is_true);
+  } else if (a.is_false) {
+    return b.is_false && are_models_isomorphic(a.is_false, b.is_false);
+  } else {
+    // A transition cex rejects a candidate based on its value in each of
+    // the two models separately, so they need not share an isomorphism.
+    return b.hypothesis
+        && are_models_isomorphic(a.hypothesis, b.hypothesis)
+        && are_models_isomorphic(a.conclusion, b.conclusion);
+  }
+}
+
+bool CexDeduplicator::add(Counterexample const& cex)
+{
+  if (cex.none) {
+    return true;
+  }
+  uint64_t h = cex_hash(cex);
+  auto range = seen.equal_range(h);
+  for (auto it = range.first; it != range.second; ++it) {
+    if (are_cexes_isomorphic(cex, it->second)) {
+      numDuplicateCexes++;
+      return false;
+    }
+  }
+  seen.insert(make_pair(h, cex));
+  return true;
+}
+
 class OverlordCandidateSolver : public CandidateSolver {
 public:
   vector<TemplateSubSlice> sub_slices;
@@ -20,6 +78,7 @@ public:
   vector<int> inv_idx;
   vector<Counterexample> cexes;
   vector<value> invs;
+  CexDeduplicator cex_dedup;
 
   int idx;
   int solver_idx;
@@ -27,7 +86,8 @@ public:
 
   OverlordCandidateSolver(
       shared_ptr<Module> module,
-      vector<TemplateSubSlice> const& sub_slices)
+      vector<TemplateSubSlice> const& sub_slices,
+      int batch_size)
   {
     this->sub_slices = sub_slices;
 
@@ -42,11 +102,14 @@ public:
       cout << "--- Initializing enumerator ---" << endl;
       cout << spaces[i] << endl;
 
-      solvers.push_back(shared_ptr<CandidateSolver>(
-          spaces[i].depth == 2
-              ? (CandidateSolver*)new AltDepth2CandidateSolver(module, spaces[i])
-              : (CandidateSolver*)new AltDisjunctCandidateSolver(module, spaces[i])
-          ));
+      if (spaces[i].depth == 2) {
+        solvers.push_back(shared_ptr<CandidateSolver>(
+            new AltDepth2CandidateSolver(module, spaces[i])));
+      } else {
+        AltDisjunctCandidateSolver* cs = new AltDisjunctCandidateSolver(module, spaces[i]);
+        cs->batch_size = batch_size;
+        solvers.push_back(shared_ptr<CandidateSolver>(cs));
+      }
       cex_idx.push_back(0);
       inv_idx.push_back(0);
     }
@@ -109,6 +172,9 @@ public:
   }
 
   void addCounterexample(Counterexample cex) {
+    if (!cex_dedup.add(cex)) {
+      return;
+    }
     cexes.push_back(cex);
     solvers[solver_idx]->addCounterexample(cex);
     cex_idx[solver_idx]++;
@@ -136,16 +202,468 @@ public:
     return res;
   }
 
+  vector<long long> getCexKillCounts() {
+    vector<long long> res;
+    for (int i = 0; i < (int)solvers.size(); i++) {
+      add_kill_counts(res, solvers[i]->getCexKillCounts());
+    }
+    return res;
+  }
+
+  void setSubSlice(TemplateSubSlice const& tss) {
+    assert(false);
+  }
+
+  vector<TemplateSubSlice> splitSubSlice(TemplateSubSlice const& tss) {
+    assert(false);
+  }
+
+  void recheckLast() {
+    assert(false);
+  }
+};
+
+// Multi-threaded version of the OverlordCandidateSolver. Each worker thread
+// has its own enumerator per space. The sub-slices ("units") are still handed
+// out in order, but idle workers enumerate ahead on the following units and
+// park on the first candidate they find. When the consumer gets to a parked
+// unit, the candidate is rechecked against any counterexamples and invariants
+// that were added in the meantime, so the sequence of candidates does not
+// depend on the number of threads or on timing. For the same reason, workers
+// defer equivalence hits (see defer_equivalent_invariants): the consumer
+// takes a parked candidate that is equivalent to an existing invariant only
+// once it is up to date, and then adds it to every worker's trie for that
+// space, in the order the serial solver would have.
+//
+// When fewer units are left than there are workers, the next unit is split
+// into finer prefixes so that the idle workers can share it. A worker that
+// finds no unit left to claim steals the back half of the finer prefixes that
+// a running AltDisjunctCandidateSolver has not got to yet (see
+// stopTopIndexAt); they become new units right after the one they came from.
+
+enum class UnitState {
+  Pending,    // not claimed by any worker yet
+  Running,    // a worker is enumerating it
+  Parked,     // the worker found a candidate and waits for the consumer
+  Returned,   // the candidate was returned from getNext()
+  Done
+};
+
+struct EnumUnit {
+  TemplateSubSlice tss;
+  int space_idx;
+  UnitState state;
+  bool recheck;
+
+  value candidate;
+  // index-sequence of the candidate if it is equivalent to an existing
+  // invariant, else empty
+  vector<int> equivalent;
+  // number of cexes / invs / equivalence hits the candidate has been
+  // checked against
+  int num_cexes;
+  int num_invs;
+  int num_equivalents;
+
+  // worker whose enumerator is set to this unit, or -1
+  int worker;
+  // splitSubSlice(tss), once it has been needed
+  vector<TemplateSubSlice> finer;
+
+  EnumUnit(TemplateSubSlice const& tss, int space_idx)
+    : tss(tss), space_idx(space_idx), state(UnitState::Pending),
+      recheck(false), num_cexes(0), num_invs(0), num_equivalents(0),
+      worker(-1) { }
+};
+
+class ParallelOverlordCandidateSolver : public CandidateSolver {
+public:
+  int nthreads;
+  vector<TemplateSpace> spaces;
+
+  // indexed by [worker][space]
+  vector<vector<shared_ptr<CandidateSolver>>> solvers;
+  // the same solvers if they are AltDisjunctCandidateSolvers, else null
+  vector<vector<AltDisjunctCandidateSolver*>> disjunct_solvers;
+  vector<vector<int>> cex_idx;
+  vector<vector<int>> inv_idx;
+  vector<vector<int>> equivalent_idx;
+  // copies of each solver's kill counts, taken whenever its getNext() returns.
+  // They include the rejections seen by candidates that were enumerated
+  // ahead and rechecked later, so they are higher than in a serial run.
+  vector<vector<vector<long long>>> cex_kills;
+
+  vector<Counterexample> cexes;
+  vector<value> invs;
+  CexDeduplicator cex_dedup;
+  // equivalence hits taken by the consumer, per space
+  vector<vector<vector<int>>> equivalents;
+
+  // In the order the consumer takes them. Units before idx are Done.
+  vector<shared_ptr<EnumUnit>> units;
+  int idx;
+  bool shutting_down;
+  int num_steals;
+
+  mutex m;
+  condition_variable cv;
+  vector<thread> workers;
+
+  ParallelOverlordCandidateSolver(
+      shared_ptr<Module> module,
+      vector<TemplateSubSlice> const& sub_slices,
+      int nthreads,
+      int batch_size)
+    : nthreads(nthreads)
+  {
+    cout << "ParallelOverlordCandidateSolver (" << nthreads << " threads)" << endl;
+
+    spaces = finer_spaces_containing_sub_slices(module, sub_slices);
+
+    solvers.resize(nthreads);
+    disjunct_solvers.resize(nthreads);
+    cex_idx.resize(nthreads);
+    inv_idx.resize(nthreads);
+    equivalent_idx.resize(nthreads);
+    cex_kills.resize(nthreads);
+    equivalents.resize(spaces.size());
+    for (int w = 0; w < nthreads; w++) {
+      for (int i = 0; i < (int)spaces.size(); i++) {
+        cout << endl;
+        cout << "--- Initializing enumerator (thread " << w << ") ---" << endl;
+        cout << spaces[i] << endl;
+
+        if (spaces[i].depth == 2) {
+          solvers[w].push_back(shared_ptr<CandidateSolver>(
+              new AltDepth2CandidateSolver(module, spaces[i])));
+          disjunct_solvers[w].push_back(nullptr);
+        } else {
+          AltDisjunctCandidateSolver* cs = new AltDisjunctCandidateSolver(module, spaces[i]);
+          cs->defer_equivalent_invariants = true;
+          cs->stealable = true;
+          cs->batch_size = batch_size;
+          solvers[w].push_back(shared_ptr<CandidateSolver>(cs));
+          disjunct_solvers[w].push_back(cs);
+        }
+        cex_idx[w].push_back(0);
+        inv_idx[w].push_back(0);
+        equivalent_idx[w].push_back(0);
+        cex_kills[w].push_back({});
+      }
+    }
+
+    for (TemplateSubSlice const& tss : sub_slices) {
+      int space_idx = -1;
+      for (int i = 0; i < (int)spaces.size(); i++) {
+        if (is_subspace(tss, spaces[i])) {
+          space_idx = i;
+          break;
+        }
+      }
+      assert (space_idx != -1);
+      units.push_back(make_shared<EnumUnit>(tss, space_idx));
+    }
+
+    idx = 0;
+    shutting_down = false;
+    num_steals = 0;
+
+    for (int w = 0; w < nthreads; w++) {
+      workers.push_back(thread(&ParallelOverlordCandidateSolver::run_worker, this, w));
+    }
+  }
+
+  ~ParallelOverlordCandidateSolver() {
+    {
+      unique_lock<mutex> lock(m);
+      shutting_down = true;
+    }
+    cv.notify_all();
+    for (thread& t : workers) {
+      t.join();
+    }
+  }
+
+  // Must hold the lock. Returns null if there is nothing left to claim.
+  shared_ptr<EnumUnit> claim_unit() {
+    int i = idx;
+    while (i < (int)units.size() && units[i]->state != UnitState::Pending) {
+      i++;
+    }
+
+    while (i < (int)units.size()
+        && (int)units.size() - i < nthreads
+        && (int)units[i]->tss.prefix.size() < units[i]->tss.ts.k)
+    {
+      shared_ptr<EnumUnit> unit = units[i];
+      vector<TemplateSubSlice> finer =
+          solvers[0][unit->space_idx]->splitSubSlice(unit->tss);
+      units.erase(units.begin() + i);
+      for (int j = 0; j < (int)finer.size(); j++) {
+        units.insert(units.begin() + i + j,
+            make_shared<EnumUnit>(finer[j], unit->space_idx));
+      }
+    }
+
+    if (i < (int)units.size()) {
+      return units[i];
+    }
+    return steal_unit();
+  }
+
+  // Must hold the lock. Takes the back half of what is left of the first
+  // running unit that can spare some, or returns null.
+  shared_ptr<EnumUnit> steal_unit() {
+    for (int i = idx; i < (int)units.size(); i++) {
+      EnumUnit& unit = *units[i];
+      int level = unit.tss.prefix.size();
+      if (unit.state != UnitState::Running || unit.worker == -1
+          || level >= unit.tss.ts.k) {
+        continue;
+      }
+      AltDisjunctCandidateSolver* ds =
+          disjunct_solvers[unit.worker][unit.space_idx];
+      if (!ds) {
+        continue;
+      }
+
+      if (unit.finer.empty()) {
+        unit.finer = solvers[0][unit.space_idx]->splitSubSlice(unit.tss);
+      }
+      int top, limit;
+      ds->getTopRange(top, limit);
+      int lo = 0;
+      while (lo < (int)unit.finer.size() && unit.finer[lo].prefix[level] <= top) {
+        lo++;
+      }
+      int hi = lo;
+      while (hi < (int)unit.finer.size() && unit.finer[hi].prefix[level] < limit) {
+        hi++;
+      }
+      if (lo == hi) {
+        continue;
+      }
+
+      int from = lo + (hi - lo) / 2;
+      if (!ds->stopTopIndexAt(unit.finer[from].prefix[level])) {
+        continue;
+      }
+      vector<shared_ptr<EnumUnit>> stolen;
+      for (int j = from; j < hi; j++) {
+        stolen.push_back(make_shared<EnumUnit>(unit.finer[j], unit.space_idx));
+      }
+      units.insert(units.begin() + i + 1, stolen.begin(), stolen.end());
+      num_steals++;
+      return stolen[0];
+    }
+    return nullptr;
+  }
+
+  // Must hold the lock
+  bool all_done() {
+    for (int i = idx; i < (int)units.size(); i++) {
+      if (units[i]->state != UnitState::Done) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void run_worker(int w) {
+    unique_lock<mutex> lock(m);
+    while (!shutting_down) {
+      shared_ptr<EnumUnit> unit = claim_unit();
+      if (!unit) {
+        // Running units may still have something to steal later on.
+        if (all_done()) {
+          break;
+        }
+        cv.wait(lock);
+        continue;
+      }
+      unit->state = UnitState::Running;
+      int s = unit->space_idx;
+      shared_ptr<CandidateSolver> solver = solvers[w][s];
+      AltDisjunctCandidateSolver* disjunct_solver = disjunct_solvers[w][s];
+      TemplateSubSlice tss = unit->tss;
+      lock.unlock();
+      solver->setSubSlice(tss);
+      lock.lock();
+      unit->worker = w;
+      cv.notify_all();
+
+      while (true) {
+        vector<value> new_invs(invs.begin() + inv_idx[w][s], invs.end());
+        vector<Counterexample> new_cexes(cexes.begin() + cex_idx[w][s], cexes.end());
+        vector<vector<int>> new_equivalents(
+            equivalents[s].begin() + equivalent_idx[w][s], equivalents[s].end());
+        inv_idx[w][s] = invs.size();
+        cex_idx[w][s] = cexes.size();
+        equivalent_idx[w][s] = equivalents[s].size();
+        bool recheck = unit->recheck;
+        unit->recheck = false;
+
+        lock.unlock();
+        for (value inv : new_invs) {
+          solver->addExistingInvariant(inv);
+        }
+        for (vector<int> const& indices : new_equivalents) {
+          disjunct_solver->existing_invariants_append(indices);
+        }
+        for (Counterexample const& cex : new_cexes) {
+          solver->addCounterexample(cex);
+        }
+        if (recheck) {
+          solver->recheckLast();
+        }
+        value next = solver->getNext();
+        vector<long long> kills = solver->getCexKillCounts();
+        vector<int> equivalent;
+        if (next != nullptr && disjunct_solver) {
+          equivalent = disjunct_solver->last_equivalent;
+        }
+        lock.lock();
+        cex_kills[w][s] = move(kills);
+
+        if (next == nullptr) {
+          unit->state = UnitState::Done;
+          unit->worker = -1;
+          cv.notify_all();
+          break;
+        }
+
+        unit->state = UnitState::Parked;
+        unit->candidate = next;
+        unit->equivalent = move(equivalent);
+        unit->num_cexes = cex_idx[w][s];
+        unit->num_invs = inv_idx[w][s];
+        unit->num_equivalents = equivalent_idx[w][s];
+        cv.notify_all();
+
+        cv.wait(lock, [&]{
+          return shutting_down || unit->state == UnitState::Running;
+        });
+        if (shutting_down) {
+          return;
+        }
+      }
+    }
+  }
+
+  value getNext() {
+    unique_lock<mutex> lock(m);
+    while (idx < (int)units.size()) {
+      if (units[idx]->state == UnitState::Returned) {
+        units[idx]->state = UnitState::Running;
+        cv.notify_all();
+      }
+
+      cv.wait(lock, [&]{
+        return units[idx]->state == UnitState::Parked
+            || units[idx]->state == UnitState::Done;
+      });
+
+      if (units[idx]->state == UnitState::Done) {
+        idx++;
+        if (idx % 100 == 0 || idx == (int)units.size()) {
+          cout << "ParallelOverlordCandidateSolver: index " << idx << " / "
+               << units.size() << endl;
+        }
+        continue;
+      }
+
+      if (units[idx]->num_cexes == (int)cexes.size()
+          && units[idx]->num_invs == (int)invs.size()
+          && units[idx]->num_equivalents
+              == (int)equivalents[units[idx]->space_idx].size()) {
+        if (!units[idx]->equivalent.empty()) {
+          // The serial solver would add this one to its trie and move on.
+          equivalents[units[idx]->space_idx].push_back(units[idx]->equivalent);
+          units[idx]->candidate = nullptr;
+          units[idx]->state = UnitState::Running;
+          cv.notify_all();
+          continue;
+        }
+        units[idx]->state = UnitState::Returned;
+        value res = units[idx]->candidate;
+        units[idx]->candidate = nullptr;
+        return res;
+      }
+
+      units[idx]->recheck = true;
+      units[idx]->state = UnitState::Running;
+      cv.notify_all();
+    }
+
+    cout << endl << "ParallelOverlordCandidateSolver: done ("
+         << num_steals << " steals)" << endl << endl;
+    return nullptr;
+  }
+
+  void addCounterexample(Counterexample cex) {
+    unique_lock<mutex> lock(m);
+    if (!cex_dedup.add(cex)) {
+      return;
+    }
+    cexes.push_back(cex);
+  }
+
+  void addExistingInvariant(value inv) {
+    unique_lock<mutex> lock(m);
+    invs.push_back(inv);
+  }
+
+  long long getProgress() {
+    return -1;
+  }
+
+  long long getSpaceSize() {
+    assert(false);
+  }
+
+  long long getPreSymmCount() {
+    long long res = 0;
+    for (int i = 0; i < (int)solvers[0].size(); i++) {
+      res += solvers[0][i]->getPreSymmCount();
+    }
+    return res;
+  }
+
+  vector<long long> getCexKillCounts() {
+    unique_lock<mutex> lock(m);
+    vector<long long> res;
+    for (int w = 0; w < nthreads; w++) {
+      for (int i = 0; i < (int)spaces.size(); i++) {
+        add_kill_counts(res, cex_kills[w][i]);
+      }
+    }
+    return res;
+  }
+
   void setSubSlice(TemplateSubSlice const& tss) {
     assert(false);
   }
+
+  vector<TemplateSubSlice> splitSubSlice(TemplateSubSlice const& tss) {
+    assert(false);
+  }
+
+  void recheckLast() {
+    assert(false);
+  }
 };
 
 std::shared_ptr<CandidateSolver> make_candidate_solver(
     std::shared_ptr<Module> module,
     vector<TemplateSubSlice> const& sub_slices,
-    bool ensure_nonredundant)
+    bool ensure_nonredundant,
+    int nthreads,
+    int batch_size)
 {
+  if (nthreads > 1) {
+    return shared_ptr<CandidateSolver>(
+        new ParallelOverlordCandidateSolver(module, sub_slices, nthreads, batch_size));
+  }
   return shared_ptr<CandidateSolver>(
-      new OverlordCandidateSolver(module, sub_slices));
+      new OverlordCandidateSolver(module, sub_slices, batch_size));
 }
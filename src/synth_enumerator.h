@@ -6,6 +6,8 @@
 #include "template_counter.h"
 
 #include <string>
+#include <atomic>
+#include <algorithm>
 
 struct Options {
   bool get_space_size;
@@ -25,9 +27,21 @@ struct Options {
 
   bool non_accumulative;
 
-  //int threads;
+  // run the checks for a candidate concurrently, keeping the first
+  // counterexample in the usual order (only the incremental inductiveness
+  // checks overlap; the rest still go through context_solve one by one)
+  bool concurrent_checks;
+
+  // number of enumeration worker threads
+  int threads;
+
+  // number of candidates the enumerator filters at once
+  int batch_size;
 
   std::string invariant_log_filename;
+
+  // counterexamples are exchanged with other processes through this file
+  std::string shared_cex_log_filename;
 };
 
 struct Counterexample {
@@ -48,11 +62,56 @@ struct Counterexample {
   json11::Json to_json() const;
   static Counterexample from_json(json11::Json, std::shared_ptr<Module>);
 
+  std::string to_binary() const;
+  static Counterexample from_binary(std::string const&, std::shared_ptr<Module>);
+
   bool is_valid() const {
     return none || is_true || is_false || (hypothesis && conclusion);
   }
 };
 
+// The order in which an enumerator tries its counterexamples on a candidate.
+// Consecutive candidates tend to get rejected by the same few counterexamples,
+// so whichever one rejects a candidate is moved to the front. New
+// counterexamples also start out at the front, since they were found by
+// refuting the last candidate.
+struct CexOrder {
+  // indices into the enumerator's cexes, in the order to try them
+  std::vector<int> order;
+  // kills[i] is the number of candidates cex i rejected. Prefixes it
+  // rejected are only counted in numDoomedPrefixes.
+  std::vector<long long> kills;
+
+  void add() {
+    order.insert(order.begin(), (int)kills.size());
+    kills.push_back(0);
+  }
+
+  int size() const { return order.size(); }
+  int operator[](int j) const { return order[j]; }
+
+  void record_kill(int j, long long n = 1) {
+    kills[order[j]] += n;
+    move_to_front(j);
+  }
+
+  void move_to_front(int j) {
+    std::rotate(order.begin(), order.begin() + j, order.begin() + j + 1);
+  }
+};
+
+// Counterexamples seen so far, by model_canonical_hash. A counterexample
+// whose models are isomorphic to an earlier one's rejects exactly the same
+// candidates, so there is no need to hand it to the enumerators.
+class CexDeduplicator {
+public:
+  // Returns false if an isomorphic counterexample was added before.
+  bool add(Counterexample const& cex);
+
+private:
+  std::unordered_multimap<uint64_t, Counterexample> seen;
+};
+
 class CandidateSolver {
 public:
   virtual ~CandidateSolver() {}
@@ -64,7 +123,19 @@ public:
   virtual long long getPreSymmCount() = 0;
   virtual long long getSpaceSize() = 0;
 
+  // Number of candidates each counterexample rejected, in the order the
+  // counterexamples were added.
+  virtual std::vector<long long> getCexKillCounts() = 0;
+
   virtual void setSubSlice(TemplateSubSlice const&) = 0;
+
+  // Split a sub-slice into finer sub-slices which together enumerate
+  // the same candidates, in the same order.
+  virtual std::vector<TemplateSubSlice> splitSubSlice(TemplateSubSlice const&) = 0;
+
+  // Have the next getNext() call reconsider the last candidate returned
+  // (against any counterexamples / invariants added since) before moving on.
+  virtual void recheckLast() = 0;
 };
 
 //std::shared_ptr<CandidateSolver> make_sat_candidate_solver(
@@ -85,11 +156,18 @@ public:
 std::shared_ptr<CandidateSolver> make_candidate_solver(
     std::shared_ptr<Module> module,
     std::vector<TemplateSubSlice> const& sub_slices, 
-    bool ensure_nonredundant);
+    bool ensure_nonredundant,
+    int nthreads,
+    int batch_size);
 
 //std::shared_ptr<CandidateSolver> compose_candidate_solvers(
   //std::vector<std::shared_ptr<CandidateSolver>> const& solvers);
 
-extern int numEnumeratedFilteredRedundantInvariants;
+extern std::atomic<int> numEnumeratedFilteredRedundantInvariants;
+extern std::atomic<long long> numCandidateBatches;
+extern std::atomic<long long> numBatchedCandidates;
+extern std::atomic<long long> numBatchSurvivors;
+extern std::atomic<long long> numDuplicateCexes;
+extern std::atomic<long long> numDoomedPrefixes;
 
 #endif
@@ -3,6 +3,7 @@
 #include <iostream>
 #include <fstream>
 #include <streambuf>
+#include <algorithm>
 
 #include "lib/json11/json11.hpp"
 
@@ -11,12 +12,14 @@
 #include "benchmarking.h"
 #include "bmc.h"
 #include "quantifier_permutations.h"
+#include "shared_cex_log.h"
 #include "top_quantifier_desc.h"
 #include "strengthen_invariant.h"
 #include "filter.h"
 #include "synth_enumerator.h"
 #include "utils.h"
 #include "solve.h"
+#include "subsequence_trie.h"
 
 using namespace std;
 using namespace json11;
@@ -48,124 +51,160 @@ Counterexample get_bmc_counterexample(
   }
 }
 
-shared_ptr<InductionContext> get_counterexample_test_with_conjs_make_indctx(
-    shared_ptr<Module> module,
+// The conjuncts of cur_invariant, so that the incremental solvers can keep
+// the ones they were given before.
+vector<value> invariant_conjuncts(value cur_invariant)
+{
+  if (!cur_invariant) {
+    return {};
+  }
+  if (And* a = value_cast<And>(cur_invariant.get())) {
+    return a->args;
+  }
+  return {cur_invariant};
+}
+
+enum class CexType { Init, Safety, Inductive };
+
+struct CexCheck {
+  OrderedCheck check;
+  CexType type;
+};
+
+// Runs `checks` as solve_in_order does and fills in `cex` from the first one
+// that is not unsat. Returns false if they all are.
+bool run_cex_checks(
+    vector<CexCheck> const& checks,
     Options const& options,
-    shared_ptr<BackgroundContext> bgctx,
-    value cur_invariant,
-    value candidate,
-    vector<value> conjectures,
-    int j)
+    Counterexample& cex)
 {
-  auto indctx = shared_ptr<InductionContext>(new InductionContext(bgctx, module, j));
-  smt::solver& solver = indctx->ctx->solver;
-  if (cur_invariant) {
-    solver.add(indctx->e1->value2expr(cur_invariant));
+  vector<OrderedCheck> ordered;
+  for (CexCheck const& c : checks) {
+    ordered.push_back(c.check);
   }
-  solver.add(indctx->e1->value2expr(candidate));
-  for (value conj : conjectures) {
-    solver.add(indctx->e1->value2expr(conj));
+
+  ContextSolverResult csr;
+  int i = solve_in_order(ordered, options.concurrent_checks, csr);
+  if (i == -1) {
+    return false;
   }
-  return indctx;
+
+  if (csr.res == smt::SolverResult::Sat) {
+    switch (checks[i].type) {
+      case CexType::Init:
+        cex.is_true = csr.models[0];
+        printf("counterexample type: INIT\n");
+        break;
+      case CexType::Safety:
+        cex.is_false = csr.models[0];
+        printf("counterexample type: SAFETY\n");
+        break;
+      case CexType::Inductive:
+        cex.hypothesis = csr.models[0];
+        cex.conclusion = csr.models[1];
+        printf("counterexample type: INDUCTIVE\n");
+        break;
+    }
+  }
+  return true;
 }
 
-Counterexample get_counterexample_test_with_conjs(
+CexCheck init_cex_check(
     shared_ptr<Module> module,
     Options const& options,
-    value cur_invariant,
-    value candidate,
-    vector<value> conjectures)
+    value candidate)
 {
-  Counterexample cex;
-  cex.none = false;
+  CexCheck c;
+  c.type = CexType::Init;
+  c.check = [module, &options, candidate](atomic<bool> const& cancelled) {
+    return context_solve(
+        "init-check",
+        module,
+        options.minimal_models ? ModelType::Min : ModelType::Any,
+        Strictness::TryHard,
+        candidate /* hint */,
+        [module, candidate](shared_ptr<BackgroundContext> bgctx)
+    {
+      auto initctx = shared_ptr<InitContext>(new InitContext(bgctx, module));
+      smt::solver& init_solver = initctx->ctx->solver;
+      init_solver.add(initctx->e->value2expr(v_not(candidate)));
+      return vector<shared_ptr<ModelEmbedding>>{initctx->e};
+    }, &cancelled);
+  };
+  return c;
+}
 
-  ContextSolverResult csr = context_solve(
-      "init-check",
+CexCheck inductive_cex_check(
+    shared_ptr<Module> module,
+    Options const& options,
+    int j,
+    vector<value> const& invs,
+    value candidate)
+{
+  CexCheck c;
+  c.type = CexType::Inductive;
+  c.check = incremental_induction_check(
+      "inductivity-check: " + module->action_names[j],
       module,
+      j,
       options.minimal_models ? ModelType::Min : ModelType::Any,
       Strictness::TryHard,
       candidate /* hint */,
-      [module, candidate](shared_ptr<BackgroundContext> bgctx)
+      2 /* num_models */,
+      invs,
+      [candidate](InductionContext& indctx)
   {
-    auto initctx = shared_ptr<InitContext>(new InitContext(bgctx, module));
-    smt::solver& init_solver = initctx->ctx->solver;
-    init_solver.add(initctx->e->value2expr(v_not(candidate)));
-    return vector<shared_ptr<ModelEmbedding>>{initctx->e};
+    return indctx.e1->value2expr(candidate)
+        && indctx.e2->value2expr(v_not(candidate));
   });
+  return c;
+}
 
-  if (csr.res == smt::SolverResult::Unknown) {
-    return cex;
-  }
+Counterexample get_counterexample_test_with_conjs(
+    shared_ptr<Module> module,
+    Options const& options,
+    value cur_invariant,
+    value candidate,
+    vector<value> conjectures)
+{
+  Counterexample cex;
+  cex.none = false;
 
-  if (csr.res == smt::SolverResult::Sat) {
-    cex.is_true = csr.models[0];
-    printf("counterexample type: INIT\n");
-    return cex;
-  }
+  vector<value> invs = invariant_conjuncts(cur_invariant);
+  vector_append(invs, conjectures);
+
+  vector<CexCheck> checks;
+  checks.push_back(init_cex_check(module, options, candidate));
 
   for (int k = 0; k < (int)conjectures.size(); k++) {
     for (int j = 0; j < (int)module->actions.size(); j++) {
-      ContextSolverResult csr = context_solve(
+      CexCheck c;
+      c.type = CexType::Safety;
+      c.check = incremental_induction_check(
           "inductivity-check-with-conj: " + module->action_names[j],
           module,
+          j,
           options.minimal_models ? ModelType::Min : ModelType::Any,
           Strictness::TryHard,
           candidate /* hint */,
-          [module, k, j, &options, cur_invariant, candidate, &conjectures](shared_ptr<BackgroundContext> bgctx)
+          1 /* num_models */,
+          invs,
+          [k, candidate, &conjectures](InductionContext& indctx)
       {
-        auto indctx = get_counterexample_test_with_conjs_make_indctx(
-              module, options, bgctx, cur_invariant, candidate, conjectures, j);
-        smt::solver& solver = indctx->ctx->solver;
-
-        solver.add(indctx->e2->value2expr(v_not(conjectures[k])));
-
-        return vector<shared_ptr<ModelEmbedding>>{indctx->e1};
+        return indctx.e1->value2expr(candidate)
+            && indctx.e2->value2expr(v_not(conjectures[k]));
       });
-
-      if (csr.res == smt::SolverResult::Unknown) {
-        return cex;
-      }
-
-      if (csr.res == smt::SolverResult::Sat) {
-        cex.is_false = csr.models[0];
-        printf("counterexample type: SAFETY\n");
-        return cex;
-      }
+      checks.push_back(c);
     }
   }
 
   for (int j = 0; j < (int)module->actions.size(); j++) {
-    ContextSolverResult csr = context_solve(
-          "inductivity-check: " + module->action_names[j],
-          module,
-          options.minimal_models ? ModelType::Min : ModelType::Any,
-          Strictness::TryHard,
-          candidate /* hint */,
-          [module, &options, cur_invariant, candidate, &conjectures, j](shared_ptr<BackgroundContext> bgctx)
-    {
-      auto indctx = get_counterexample_test_with_conjs_make_indctx(
-            module, options, bgctx, cur_invariant, candidate, conjectures, j);
-
-      smt::solver& solver = indctx->ctx->solver;
-
-      solver.add(indctx->e2->value2expr(v_not(candidate)));
-
-      return vector<shared_ptr<ModelEmbedding>>{indctx->e1, indctx->e2};
-    });
-
-    if (csr.res == smt::SolverResult::Unknown) {
-      return cex;
-    }
-
-    if (csr.res == smt::SolverResult::Sat) {
-      cex.hypothesis = csr.models[0];
-      cex.conclusion = csr.models[1];
-      printf("counterexample type: INDUCTIVE\n");
-      return cex;
-    }
+    checks.push_back(inductive_cex_check(module, options, j, invs, candidate));
   }
 
-  cex.none = true;
+  if (!run_cex_checks(checks, options, cex)) {
+    cex.none = true;
+  }
   return cex;
 }
 
@@ -181,102 +220,58 @@ Counterexample get_counterexample_simple(
   Counterexample cex;
   cex.none = false;
 
-  ContextSolverResult csr = context_solve(
-      "init-check",
-      module,
-      options.minimal_models ? ModelType::Min : ModelType::Any,
-      Strictness::TryHard,
-      candidate /* hint */,
-      [module, candidate](shared_ptr<BackgroundContext> bgctx)
-  {
-    auto initctx = shared_ptr<InitContext>(new InitContext(bgctx, module));
-    smt::solver& init_solver = initctx->ctx->solver;
-    init_solver.add(initctx->e->value2expr(v_not(candidate)));
-    return vector<shared_ptr<ModelEmbedding>>{initctx->e};
-  });
-
-  if (csr.res == smt::SolverResult::Unknown) {
-    return cex;
-  }
-
-  if (csr.res == smt::SolverResult::Sat) {
-    cex.is_true = csr.models[0];
-    printf("counterexample type: INIT\n");
-    return cex;
-  }
+  vector<CexCheck> checks;
+  checks.push_back(init_cex_check(module, options, candidate));
 
   if (check_implies_conj) {
-    ContextSolverResult csr = context_solve(
-      "conj-check",
-      module,
-      options.minimal_models ? ModelType::Min : ModelType::Any,
-      Strictness::TryHard,
-      candidate /* hint */,
-      [module, candidate, &conjs, cur_invariant](shared_ptr<BackgroundContext> bgctx)
+    CexCheck c;
+    c.type = CexType::Safety;
+    c.check = [module, &options, candidate, &conjs, cur_invariant](
+        atomic<bool> const& cancelled)
     {
-      auto conjctx = shared_ptr<BasicContext>(new BasicContext(bgctx, module));
-
-      smt::solver& conj_solver = conjctx->ctx->solver;
-      conj_solver.add(conjctx->e->value2expr(v_not(v_and(conjs))));
-      if (cur_invariant) {
-        conj_solver.add(conjctx->e->value2expr(cur_invariant));
-      }
-      conj_solver.add(conjctx->e->value2expr(candidate));
-      return vector<shared_ptr<ModelEmbedding>>{conjctx->e};
-    });
+      return context_solve(
+        "conj-check",
+        module,
+        options.minimal_models ? ModelType::Min : ModelType::Any,
+        Strictness::TryHard,
+        candidate /* hint */,
+        [module, candidate, &conjs, cur_invariant](shared_ptr<BackgroundContext> bgctx)
+      {
+        auto conjctx = shared_ptr<BasicContext>(new BasicContext(bgctx, module));
 
-    if (csr.res == smt::SolverResult::Unknown) {
-      return cex;
-    }
+        smt::solver& conj_solver = conjctx->ctx->solver;
+        conj_solver.add(conjctx->e->value2expr(v_not(v_and(conjs))));
+        if (cur_invariant) {
+          conj_solver.add(conjctx->e->value2expr(cur_invariant));
+        }
+        conj_solver.add(conjctx->e->value2expr(candidate));
+        return vector<shared_ptr<ModelEmbedding>>{conjctx->e};
+      }, &cancelled);
+    };
+    checks.push_back(c);
+  }
 
-    if (csr.res == smt::SolverResult::Sat) {
-      cex.is_false = csr.models[0];
-      printf("counterexample type: SAFETY\n");
+  // BMC has to come between the checks above and the inductive ones.
+  if (options.pre_bmc) {
+    if (run_cex_checks(checks, options, cex)) {
       return cex;
     }
-  }
+    checks.clear();
 
-  if (options.pre_bmc) {
     Counterexample bmc_cex = get_bmc_counterexample(bmc, candidate, options);
     if (!bmc_cex.none) {
       return bmc_cex;
     }
   }
 
+  vector<value> invs = invariant_conjuncts(cur_invariant);
   for (int j = 0; j < (int)module->actions.size(); j++) {
-    ContextSolverResult csr = context_solve(
-      "inductivity-check: " + module->action_names[j],
-      module,
-      options.minimal_models ? ModelType::Min : ModelType::Any,
-      Strictness::TryHard,
-      candidate /* hint */,
-      [module, candidate, j, cur_invariant](shared_ptr<BackgroundContext> bgctx)
-    {
-      auto indctx = shared_ptr<InductionContext>(new InductionContext(bgctx, module, j));
-      smt::solver& solver = indctx->ctx->solver;
-      if (cur_invariant) {
-        solver.add(indctx->e1->value2expr(cur_invariant));
-      }
-      solver.add(indctx->e1->value2expr(candidate));
-      solver.add(indctx->e2->value2expr(v_not(candidate)));
-
-      return vector<shared_ptr<ModelEmbedding>>{indctx->e1, indctx->e2};
-    });
-
-    if (csr.res == smt::SolverResult::Unknown) {
-      return cex;
-    }
-
-    if (csr.res == smt::SolverResult::Sat) {
-      cex.hypothesis = csr.models[0];
-      cex.conclusion = csr.models[1];
-      printf("counterexample type: INDUCTIVE\n");
-      return cex;
-    }
+    checks.push_back(inductive_cex_check(module, options, j, invs, candidate));
   }
 
-  cex.none = true;
-
+  if (!run_cex_checks(checks, options, cex)) {
+    cex.none = true;
+  }
   return cex;
 }
 
@@ -416,6 +411,54 @@ Counterexample Counterexample::from_json(Json j, shared_ptr<Module> module) {
   return cex;
 }
 
+string Counterexample::to_binary() const {
+  string res;
+  if (none) {
+    res.push_back('n');
+  }
+  else if (is_true) {
+    res.push_back('t');
+    is_true->to_binary(res);
+  }
+  else if (is_false) {
+    res.push_back('f');
+    is_false->to_binary(res);
+  }
+  else {
+    assert(hypothesis != nullptr);
+    assert(conclusion != nullptr);
+    res.push_back('i');
+    hypothesis->to_binary(res);
+    conclusion->to_binary(res);
+  }
+  return res;
+}
+
+Counterexample Counterexample::from_binary(string const& s, shared_ptr<Module> module) {
+  Counterexample cex;
+  assert(s.size() >= 1);
+  size_t pos = 1;
+  if (s[0] == 'n') {
+    cex.none = true;
+  }
+  else if (s[0] == 't') {
+    cex.is_true = Model::from_binary(s, pos, module);
+  }
+  else if (s[0] == 'f') {
+    cex.is_false = Model::from_binary(s, pos, module);
+  }
+  else if (s[0] == 'i') {
+    cex.hypothesis = Model::from_binary(s, pos, module);
+    cex.conclusion = Model::from_binary(s, pos, module);
+  }
+  else {
+    assert(false);
+  }
+  assert(pos == s.size());
+
+  return cex;
+}
+
 Json Transcript::to_json() const {
   vector<Json> ar;
   for (auto p : entries) {
@@ -500,9 +543,56 @@ struct CexStats {
   }
 };
 
-int numEnumeratedFilteredRedundantInvariants = 0;
+atomic<int> numEnumeratedFilteredRedundantInvariants(0);
+atomic<long long> numCandidateBatches(0);
+atomic<long long> numBatchedCandidates(0);
+atomic<long long> numBatchSurvivors(0);
+atomic<long long> numDuplicateCexes(0);
+atomic<long long> numDoomedPrefixes(0);
+
+// Prints the kill counts of the `num_top` counterexamples that rejected the
+// most candidates, or of all of them (in order) if `all`.
+void dump_cex_kill_counts(vector<long long> const& kills, bool all) {
+  static const int num_top = 10;
+
+  long long total = 0;
+  for (long long k : kills) {
+    total += k;
+  }
+  vector<long long> sorted = kills;
+  sort(sorted.rbegin(), sorted.rend());
+  int top = ((int)sorted.size() + 9) / 10;
+  long long top_total = 0;
+  for (int i = 0; i < top; i++) {
+    top_total += sorted[i];
+  }
 
-void dump_stats(long long progress, CexStats const& cs,
+  cout << "candidates rejected by counterexamples: " << total << endl;
+  if (total > 0) {
+    cout << "rejected by the top " << top << " counterexamples: "
+         << (100 * top_total / total) << "%" << endl;
+  }
+  if (all) {
+    cout << "kills per counterexample:";
+    for (long long k : kills) {
+      cout << " " << k;
+    }
+  } else {
+    vector<pair<long long, int>> by_kills;
+    for (int i = 0; i < (int)kills.size(); i++) {
+      by_kills.push_back(make_pair(-kills[i], i));
+    }
+    int n = min(num_top, (int)by_kills.size());
+    partial_sort(by_kills.begin(), by_kills.begin() + n, by_kills.end());
+    cout << "most kills per counterexample:";
+    for (int i = 0; i < n; i++) {
+      cout << " #" << by_kills[i].second << "=" << -by_kills[i].first;
+    }
+  }
+  cout << endl;
+}
+
+void dump_stats(shared_ptr<CandidateSolver> cand_solver, CexStats const& cs,
     std::chrono::time_point<std::chrono::high_resolution_clock> init,
     int num_redundant, int num_nonredundant,
     long long filtering_ms, long long num_finishers_found,
@@ -511,9 +601,10 @@ void dump_stats(long long progress, CexStats const& cs,
     long long redundant_process_ns,
     long long nonredundant_process_ns,
     long long indef_count,
-    long long indef_ns) {
+    long long indef_ns,
+    bool final = false) {
   cout << "================= Stats =================" << endl;
-  cout << "progress: " << progress << endl;
+  cout << "progress: " << cand_solver->getProgress() << endl;
   cout << "total time running so far: " << as_ms(now() - init)
        << " ms" << endl;
   cout << "total time filtering: " << filtering_ms << " ms" << endl;
@@ -526,6 +617,7 @@ void dump_stats(long long progress, CexStats const& cs,
   cout << "total time processing nonredundant: " << nonredundant_process_ns / 1000000 << " ms" << endl;
   cout << "total time processing indef: " << indef_ns / 1000000 << " ms" << endl;
   cs.dump();
+  dump_cex_kill_counts(cand_solver->getCexKillCounts(), final);
   cout << "number of redundant invariants found: "
        << num_redundant << endl;
   cout << "number of non-redundant invariants found: "
@@ -536,20 +628,31 @@ void dump_stats(long long progress, CexStats const& cs,
   cout << "number of TryHard failures: " << numTryHardFailures << endl;
   cout << "number of candidates could not determine inductiveness: " << indef_count << endl;
   cout << "number of enumerated filtered redundant invariants: " << numEnumeratedFilteredRedundantInvariants << endl;
+  cout << "number of prefixes pruned by a counterexample: " << numDoomedPrefixes << endl;
+  if (numCandidateBatches > 0) {
+    cout << "candidate batches filtered: " << numCandidateBatches
+         << ", average size " << (numBatchedCandidates / numCandidateBatches) << endl;
+    cout << "batched candidates surviving the counterexamples: " << numBatchSurvivors
+         << " / " << numBatchedCandidates
+         << " (" << (100 * numBatchSurvivors / numBatchedCandidates) << "%)" << endl;
+  }
+  cout << "subsequence trie memory: " << subsequence_trie_bytes / 1024 << " KB" << endl;
+  cout << "isomorphic counterexamples dropped: " << numDuplicateCexes << endl;
   smt::dump_smt_stats();
+  dump_portfolio_stats();
   cout << "=========================================" << endl;
   cout.flush();
 }
 
 int get_k(value v) {
-  if (And* a = dynamic_cast<And*>(v.get())) {
+  if (And* a = value_cast<And>(v.get())) {
     int k = 0;
     for (value arg : a->args) {
       k += get_k(arg);
     }
     return k;
   }
-  else if (Or* a = dynamic_cast<Or*>(v.get())) {
+  else if (Or* a = value_cast<Or>(v.get())) {
     int k = 0;
     for (value arg : a->args) {
       k += get_k(arg);
@@ -562,10 +665,10 @@ int get_k(value v) {
 }
 
 bool has_and(value v) {
-  if (dynamic_cast<And*>(v.get())) {
+  if (value_cast<And>(v.get())) {
     return true;
   }
-  else if (Or* a = dynamic_cast<Or*>(v.get())) {
+  else if (Or* a = value_cast<Or>(v.get())) {
     for (value arg : a->args) {
       bool d = has_and(arg);
       if (d) return true;
@@ -604,6 +707,70 @@ void dump_inv_params(value v)
 
 extern const int TIMEOUT = 45 * 1000;
 
+template <typename T>
+vector<T> vector_concat(vector<T> const& a, vector<T> const& b)
+{
+  vector<T> res = a;
+  for (int i = 0; i < (int)b.size(); i++) {
+    res.push_back(b[i]);
+  }
+  return res;
+}
+
+// Counterexamples from other processes were found under their own
+// assumptions, so only use one if its pre-state also satisfies what our
+// own queries assume. `is_false_assumptions` is null if we never
+// produce SAFETY counterexamples.
+bool shared_cex_applies(
+    Counterexample const& cex,
+    vector<value> const& pre_assumptions,
+    vector<value> const* is_false_assumptions)
+{
+  shared_ptr<Model> pre;
+  vector<value> const* assumptions;
+  if (cex.is_true) {
+    return true;
+  }
+  else if (cex.is_false) {
+    if (is_false_assumptions == nullptr) {
+      return false;
+    }
+    pre = cex.is_false;
+    assumptions = is_false_assumptions;
+  }
+  else {
+    assert(cex.hypothesis != nullptr);
+    pre = cex.hypothesis;
+    assumptions = &pre_assumptions;
+  }
+
+  for (value v : *assumptions) {
+    if (!pre->eval_predicate(v)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void add_shared_cexes(
+    shared_ptr<SharedCexLog> shared_cex_log,
+    shared_ptr<CandidateSolver> cs,
+    vector<value> const& pre_assumptions,
+    vector<value> const* is_false_assumptions,
+    long long& num_shared_cexes)
+{
+  if (!shared_cex_log) {
+    return;
+  }
+  for (Counterexample const& cex : shared_cex_log->poll()) {
+    if (shared_cex_applies(cex, pre_assumptions, is_false_assumptions)) {
+      cs->addCounterexample(cex);
+      num_shared_cexes++;
+      cout << "added shared counterexample (" << num_shared_cexes << " total)" << endl;
+    }
+  }
+}
+
 SynthesisResult synth_loop(
   shared_ptr<Module> module,
   vector<TemplateSubSlice> const& slices,
@@ -611,7 +778,7 @@ SynthesisResult synth_loop(
   FormulaDump const& fd)
 {
   shared_ptr<CandidateSolver> cs = make_candidate_solver(
-      module, slices, false);
+      module, slices, false, options.threads, options.batch_size);
 
   SynthesisResult synres;
   synres.done = false;
@@ -668,6 +835,22 @@ SynthesisResult synth_loop(
 
   value result_inv;
 
+  shared_ptr<SharedCexLog> shared_cex_log;
+  if (options.shared_cex_log_filename != "") {
+    shared_cex_log.reset(new SharedCexLog(options.shared_cex_log_filename, module));
+  }
+  long long num_shared_cexes = 0;
+
+  // What our own counterexample queries assume about the pre-state
+  vector<value> cex_pre_assumptions;
+  vector<value> cex_is_false_assumptions;
+  if (options.with_conjs) {
+    cex_pre_assumptions = vector_concat(fd.base_invs, fd.conjectures);
+    cex_is_false_assumptions = cex_pre_assumptions;
+  } else {
+    cex_is_false_assumptions.push_back(v_not(v_and(fd.conjectures)));
+  }
+
   while (true) {
     num_iterations++;
 
@@ -678,6 +861,9 @@ SynthesisResult synth_loop(
     cout << "num iterations " << num_iterations << endl;
     std::cout.flush();
 
+    add_shared_cexes(shared_cex_log, cs,
+        cex_pre_assumptions, &cex_is_false_assumptions, num_shared_cexes);
+
     auto filtering_t1 = now();
     value candidate = cs->getNext();
     filtering_ns += as_ns(now() - filtering_t1);
@@ -756,6 +942,9 @@ SynthesisResult synth_loop(
     } else {
       cex_stats(cex);
       cs->addCounterexample(cex);
+      if (shared_cex_log) {
+        shared_cex_log->append(cex);
+      }
       //transcript.entries.push_back(make_pair(cex, candidate));
     }
 
@@ -764,11 +953,11 @@ SynthesisResult synth_loop(
       process_cex_ns += process_ns;
     }
 
-    dump_stats(cs->getProgress(), cexstats, t_init, 0, 0, filtering_ns/1000000, num_finishers_found, 0, 0, process_cex_ns, 0, 0, indef_count, process_indef_ns);
+    dump_stats(cs, cexstats, t_init, 0, 0, filtering_ns/1000000, num_finishers_found, 0, 0, process_cex_ns, 0, 0, indef_count, process_indef_ns);
   }
 
   //cout << transcript.to_json().dump() << endl;
-  dump_stats(cs->getProgress(), cexstats, t_init, 0, 0, filtering_ns/1000000, num_finishers_found, 0, 0, process_cex_ns, 0, 0, indef_count, process_indef_ns);
+  dump_stats(cs, cexstats, t_init, 0, 0, filtering_ns/1000000, num_finishers_found, 0, 0, process_cex_ns, 0, 0, indef_count, process_indef_ns, true);
 
   if (result_inv) {
     dump_inv_params(result_inv);
@@ -779,16 +968,6 @@ SynthesisResult synth_loop(
   return synres;
 }
 
-template <typename T>
-vector<T> vector_concat(vector<T> const& a, vector<T> const& b)
-{
-  vector<T> res = a;
-  for (int i = 0; i < (int)b.size(); i++) {
-    res.push_back(b[i]);
-  }
-  return res;
-}
-
 SynthesisResult synth_loop_incremental_breadth(
     shared_ptr<Module> module,
     vector<TemplateSubSlice> const& slices,
@@ -846,10 +1025,16 @@ SynthesisResult synth_loop_incremental_breadth(
   long long process_indef_ns = 0;
   long long indef_count = 0;
 
+  shared_ptr<SharedCexLog> shared_cex_log;
+  if (options.shared_cex_log_filename != "") {
+    shared_cex_log.reset(new SharedCexLog(options.shared_cex_log_filename, module));
+  }
+  long long num_shared_cexes = 0;
+
   while (true) {
     num_iterations_outer++;
 
-    shared_ptr<CandidateSolver> cs = make_candidate_solver(module, slices, true);
+    shared_ptr<CandidateSolver> cs = make_candidate_solver(module, slices, true, options.threads, options.batch_size);
 
     if (options.get_space_size) {
       long long s = cs->getSpaceSize();
@@ -870,6 +1055,13 @@ SynthesisResult synth_loop_incremental_breadth(
 
       cout << endl;
 
+      vector<value> const& cur_invs =
+          options.non_accumulative
+            ? (options.breadth_with_conjs ? base_invs_plus_conjs : fd.base_invs)
+            : (options.breadth_with_conjs ? conjs_plus_base_invs_plus_new_invs : base_invs_plus_new_invs);
+
+      add_shared_cexes(shared_cex_log, cs, cur_invs, nullptr, num_shared_cexes);
+
       auto filtering_t1 = now();
       value candidate0 = cs->getNext();
       filtering_ns += as_ns(now() - filtering_t1);
@@ -889,11 +1081,7 @@ SynthesisResult synth_loop_incremental_breadth(
 
       Counterexample cex = get_counterexample_simple(
                 module, options, bmc, false /* check_implies_conj */, fd.conjectures,
-                v_and(
-                  options.non_accumulative
-                    ? (options.breadth_with_conjs ? base_invs_plus_conjs : fd.base_invs)
-                    : (options.breadth_with_conjs ? conjs_plus_base_invs_plus_new_invs : base_invs_plus_new_invs)
-                ),
+                v_and(cur_invs),
                 candidate);
 
       if (!cex.is_valid()) {
@@ -954,7 +1142,7 @@ SynthesisResult synth_loop_incremental_breadth(
           //if (!options.whole_space && is_invariant_with_conjectures(module, filtered_simplified_strengthened_invs)) {
           /*if (!options.whole_space && conjectures_inv(module, filtered_simplified_strengthened_invs, conjectures)) {
             cout << "invariant implies safety condition, done!" << endl;
-            dump_stats(cs->getProgress(), cexstats, t_init, num_redundant, filtering_ns/1000000, 0);
+            dump_stats(cs, cexstats, t_init, num_redundant, filtering_ns/1000000, 0);
             return SynthesisResult(true, filtered_simplified_strengthened_invs, all_invs);
           }*/
           num_nonredundant++;
@@ -969,6 +1157,9 @@ SynthesisResult synth_loop_incremental_breadth(
         auto t1 = now();
         cs->addCounterexample(cex);
         auto t2 = now();
+        if (shared_cex_log) {
+          shared_cex_log->append(cex);
+        }
         addCounterexample_ns += as_ns(t2 - t1);
         addCounterexample_count++;
         cout << "addCounterexample: " << addCounterexample_ns / 1000000 << endl;
@@ -983,10 +1174,11 @@ SynthesisResult synth_loop_incremental_breadth(
         redundant_process_ns += process_ns;
       }
 
-      dump_stats(cs->getProgress(), cexstats, t_init, num_redundant, num_nonredundant, filtering_ns/1000000, 0, addCounterexample_ns / 1000000, addCounterexample_count, cex_process_ns, redundant_process_ns, nonredundant_process_ns, indef_count, process_indef_ns);
+      dump_stats(cs, cexstats, t_init, num_redundant, num_nonredundant, filtering_ns/1000000, 0, addCounterexample_ns / 1000000, addCounterexample_count, cex_process_ns, redundant_process_ns, nonredundant_process_ns, indef_count, process_indef_ns);
     }
 
-    dump_stats(cs->getProgress(), cexstats, t_init, num_redundant, num_nonredundant, filtering_ns/1000000, 0, addCounterexample_ns / 1000000, addCounterexample_count, cex_process_ns, redundant_process_ns, nonredundant_process_ns, indef_count, process_indef_ns);
+    // The last dump for this round's candidate solver
+    dump_stats(cs, cexstats, t_init, num_redundant, num_nonredundant, filtering_ns/1000000, 0, addCounterexample_ns / 1000000, addCounterexample_count, cex_process_ns, redundant_process_ns, nonredundant_process_ns, indef_count, process_indef_ns, true);
 
     if (!any_formula_synthesized_this_round) {
       cout << "unable to synthesize any formula" << endl;
@@ -998,7 +1190,7 @@ SynthesisResult synth_loop_incremental_breadth(
             v_and(base_invs_plus_new_invs), fd.conjectures))
     {
       cout << "invariant implies safety condition, done!" << endl;
-      dump_stats(cs->getProgress(), cexstats, t_init, num_redundant, num_nonredundant, filtering_ns/1000000, 0, addCounterexample_ns / 1000000, addCounterexample_count, cex_process_ns, redundant_process_ns, nonredundant_process_ns, indef_count, process_indef_ns);
+      dump_stats(cs, cexstats, t_init, num_redundant, num_nonredundant, filtering_ns/1000000, 0, addCounterexample_ns / 1000000, addCounterexample_count, cex_process_ns, redundant_process_ns, nonredundant_process_ns, indef_count, process_indef_ns);
       return SynthesisResult(true, new_invs, all_invs);
     }
 
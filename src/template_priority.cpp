@@ -175,6 +175,34 @@ vector<vector<int>> get_prefixes(
   return get_prefixes(slice, tree_shape, sub_trans_system);
 }
 
+vector<TemplateSubSlice> split_sub_slice_by_prefix(
+    TransitionSystem const& sub_trans_system,
+    TreeShape const& tree_shape,
+    TemplateSubSlice const& tss)
+{
+  int n = tss.prefix.size();
+  assert (n < tss.ts.k);
+
+  vector<int> indices = tss.prefix;
+  indices.resize(n + 1);
+  int vis = 0;
+  for (int i = 0; i < n; i++) {
+    vis = sub_trans_system.next(vis, indices[i]);
+    assert (vis != -1);
+  }
+
+  vector<vector<int>> prefixes;
+  get_prefixes_rec(prefixes, tree_shape, indices, n, vis, sub_trans_system);
+
+  vector<TemplateSubSlice> res;
+  for (vector<int> const& pref : prefixes) {
+    TemplateSubSlice child = tss;
+    child.prefix = pref;
+    res.push_back(child);
+  }
+  return res;
+}
+
 TransitionSystem transition_system_for_slice_list(
     shared_ptr<Module> module,
     vector<TemplateSlice> const& slices,
@@ -2,6 +2,8 @@
 #define TEMPLATE_PRIORITY_H
 
 #include "template_desc.h"
+#include "template_counter.h"
+#include "tree_shapes.h"
 
 #include <vector>
 
@@ -22,4 +24,11 @@ std::vector<TemplateSlice> quantifier_combos(
     std::vector<TemplateSlice> const& forall_slices,
     int maxExists);
 
+// Extend the prefix of the sub-slice by one index. The resulting sub-slices
+// together enumerate the same candidates as the original, in the same order.
+std::vector<TemplateSubSlice> split_sub_slice_by_prefix(
+    TransitionSystem const& sub_trans_system,
+    TreeShape const& tree_shape,
+    TemplateSubSlice const& tss);
+
 #endif
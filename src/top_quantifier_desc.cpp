@@ -8,12 +8,12 @@ using namespace std;
 
 TopQuantifierDesc::TopQuantifierDesc(value v) {
   while (true) {
-    if (Forall* f = dynamic_cast<Forall*>(v.get())) {
+    if (Forall* f = value_cast<Forall>(v.get())) {
       for (VarDecl decl : f->decls) {
         d.push_back(make_pair(QType::Forall, vector<VarDecl>{decl}));
       }
       v = f->body;
-    } else if (NearlyForall* f = dynamic_cast<NearlyForall*>(v.get())) {
+    } else if (NearlyForall* f = value_cast<NearlyForall>(v.get())) {
       d.push_back(make_pair(QType::NearlyForall, f->decls));
       v = f->body;
     } else {
@@ -27,9 +27,9 @@ pair<TopQuantifierDesc, value> get_tqd_and_body(value v)
   TopQuantifierDesc tqd(v);
 
   while (true) {
-    if (Forall* f = dynamic_cast<Forall*>(v.get())) {
+    if (Forall* f = value_cast<Forall>(v.get())) {
       v = f->body;
-    } else if (NearlyForall* f = dynamic_cast<NearlyForall*>(v.get())) {
+    } else if (NearlyForall* f = value_cast<NearlyForall>(v.get())) {
       v = f->body;
     } else {
       break;
@@ -44,9 +44,9 @@ pair<TopAlternatingQuantifierDesc, value> get_taqd_and_body(value v)
   TopAlternatingQuantifierDesc taqd(v);
 
   while (true) {
-    if (Forall* f = dynamic_cast<Forall*>(v.get())) {
+    if (Forall* f = value_cast<Forall>(v.get())) {
       v = f->body;
-    } else if (Exists* e = dynamic_cast<Exists*>(v.get())) {
+    } else if (Exists* e = value_cast<Exists>(v.get())) {
       v = e->body;
     } else {
       break;
@@ -186,7 +186,7 @@ TopAlternatingQuantifierDesc::TopAlternatingQuantifierDesc(value v)
 {
   Alternation alt;
   while (true) {
-    if (Forall* f = dynamic_cast<Forall*>(v.get())) {
+    if (Forall* f = value_cast<Forall>(v.get())) {
       if (alt.decls.size() > 0 && alt.altType != AltType::Forall) {
         alts.push_back(alt);
         alt.decls = {};
@@ -199,9 +199,9 @@ TopAlternatingQuantifierDesc::TopAlternatingQuantifierDesc(value v)
       }
 
       v = f->body;
-    } else if (/* NearlyForall* f = */ dynamic_cast<NearlyForall*>(v.get())) {
+    } else if (/* NearlyForall* f = */ value_cast<NearlyForall>(v.get())) {
       assert(false);
-    } else if (Exists* f = dynamic_cast<Exists*>(v.get())) {
+    } else if (Exists* f = value_cast<Exists>(v.get())) {
       if (alt.decls.size() > 0 && alt.altType != AltType::Exists) {
         alts.push_back(alt);
         alt.decls = {};
@@ -227,10 +227,10 @@ TopAlternatingQuantifierDesc::TopAlternatingQuantifierDesc(value v)
 value TopAlternatingQuantifierDesc::get_body(value v)
 {
   while (true) {
-    if (Forall* f = dynamic_cast<Forall*>(v.get())) {
+    if (Forall* f = value_cast<Forall>(v.get())) {
       v = f->body;
     }
-    else if (Exists* f = dynamic_cast<Exists*>(v.get())) {
+    else if (Exists* f = value_cast<Exists>(v.get())) {
       v = f->body;
     }
     else {
@@ -27,33 +27,33 @@ struct NormalizeState {
 
 value normalize(value v, NormalizeState& ns) {
   assert(v.get() != NULL);
-  if (Forall* va = dynamic_cast<Forall*>(v.get())) {
+  if (Forall* va = value_cast<Forall>(v.get())) {
     return v_forall(va->decls, normalize(va->body, ns));
   }
-  else if (Exists* va = dynamic_cast<Exists*>(v.get())) {
+  else if (Exists* va = value_cast<Exists>(v.get())) {
     return v_exists(va->decls, normalize(va->body, ns));
   }
-  else if (Var* va = dynamic_cast<Var*>(v.get())) {
+  else if (Var* va = value_cast<Var>(v.get())) {
     return v_var(ns.get_name(va->name), va->sort);
   }
-  else if (dynamic_cast<Const*>(v.get())) {
+  else if (value_cast<Const>(v.get())) {
     return v;
   }
-  else if (Eq* va = dynamic_cast<Eq*>(v.get())) {
+  else if (Eq* va = value_cast<Eq>(v.get())) {
     return v_eq(
         normalize(va->left, ns),
         normalize(va->right, ns));
   }
-  else if (Not* va = dynamic_cast<Not*>(v.get())) {
+  else if (Not* va = value_cast<Not>(v.get())) {
     return v_not(
         normalize(va->val, ns));
   }
-  else if (Implies* va = dynamic_cast<Implies*>(v.get())) {
+  else if (Implies* va = value_cast<Implies>(v.get())) {
     return v_implies(
         normalize(va->left, ns),
         normalize(va->right, ns));
   }
-  else if (Apply* va = dynamic_cast<Apply*>(v.get())) {
+  else if (Apply* va = value_cast<Apply>(v.get())) {
     value func = normalize(va->func, ns);
     vector<value> args;
     for (value arg : va->args) {
@@ -61,14 +61,14 @@ value normalize(value v, NormalizeState& ns) {
     }
     return v_apply(func, args);
   }
-  else if (And* va = dynamic_cast<And*>(v.get())) {
+  else if (And* va = value_cast<And>(v.get())) {
     vector<value> args;
     for (value arg : va->args) {
       args.push_back(normalize(arg, ns));
     }
     return v_and(args);
   }
-  else if (Or* va = dynamic_cast<Or*>(v.get())) {
+  else if (Or* va = value_cast<Or>(v.get())) {
     vector<value> args;
     for (value arg : va->args) {
       args.push_back(normalize(arg, ns));
@@ -85,8 +85,8 @@ value normalize(value v, NormalizeState& ns) {
 bool is_redundant_quick(value a, value b)
 {
   while (true) {
-    Forall* a_f = dynamic_cast<Forall*>(a.get());
-    Forall* b_f = dynamic_cast<Forall*>(b.get());
+    Forall* a_f = value_cast<Forall>(a.get());
+    Forall* b_f = value_cast<Forall>(b.get());
     if (a_f == NULL || b_f == NULL) {
       break;
     }
@@ -104,15 +104,15 @@ bool is_redundant_quick(value a, value b)
     b = b_f->body;
   }
 
-  Not* a_n = dynamic_cast<Not*>(a.get());
-  Not* b_n = dynamic_cast<Not*>(b.get());
+  Not* a_n = value_cast<Not>(a.get());
+  Not* b_n = value_cast<Not>(b.get());
 
   if (a_n == NULL || b_n == NULL) {
     return false;
   }
 
-  And* a_and = dynamic_cast<And*>(a_n->val.get());
-  And* b_and = dynamic_cast<And*>(b_n->val.get());
+  And* a_and = value_cast<And>(a_n->val.get());
+  And* b_and = value_cast<And>(b_n->val.get());
   vector<value> a_and_args;
   vector<value> b_and_args;
 
@@ -33,16 +33,16 @@ void get_var_index_transition_rec(
   VarIndexTransition& vit)
 {
   assert(v.get() != NULL);
-  if (Forall* val = dynamic_cast<Forall*>(v.get())) {
+  if (Forall* val = value_cast<Forall>(v.get())) {
     get_var_index_transition_rec(groups, val->body, vit);
   }
-  else if (Exists* val = dynamic_cast<Exists*>(v.get())) {
+  else if (Exists* val = value_cast<Exists>(v.get())) {
     get_var_index_transition_rec(groups, val->body, vit);
   }
-  else if (NearlyForall* val = dynamic_cast<NearlyForall*>(v.get())) {
+  else if (NearlyForall* val = value_cast<NearlyForall>(v.get())) {
     get_var_index_transition_rec(groups, val->body, vit);
   }
-  else if (Var* val = dynamic_cast<Var*>(v.get())) {
+  else if (Var* val = value_cast<Var>(v.get())) {
     GI gi = get_gi(groups, val->name);
     // If the largest seen (`res`) jumps ahead by more than 1,
     // then update `pre`.
@@ -54,36 +54,36 @@ void get_var_index_transition_rec(
       vit.res.indices[gi.group] = gi.index;
     }
   }
-  else if (dynamic_cast<Const*>(v.get())) {
+  else if (value_cast<Const>(v.get())) {
   }
-  else if (Eq* val = dynamic_cast<Eq*>(v.get())) {
+  else if (Eq* val = value_cast<Eq>(v.get())) {
     get_var_index_transition_rec(groups, val->left, vit);
     get_var_index_transition_rec(groups, val->right, vit);
   }
-  else if (Not* val = dynamic_cast<Not*>(v.get())) {
+  else if (Not* val = value_cast<Not>(v.get())) {
     get_var_index_transition_rec(groups, val->val, vit);
   }
-  else if (Implies* val = dynamic_cast<Implies*>(v.get())) {
+  else if (Implies* val = value_cast<Implies>(v.get())) {
     get_var_index_transition_rec(groups, val->left, vit);
     get_var_index_transition_rec(groups, val->right, vit);
   }
-  else if (Apply* val = dynamic_cast<Apply*>(v.get())) {
+  else if (Apply* val = value_cast<Apply>(v.get())) {
     get_var_index_transition_rec(groups, val->func, vit);
     for (value arg : val->args) {
       get_var_index_transition_rec(groups, arg, vit);
     }
   }
-  else if (And* val = dynamic_cast<And*>(v.get())) {
+  else if (And* val = value_cast<And>(v.get())) {
     for (value arg : val->args) {
       get_var_index_transition_rec(groups, arg, vit);
     }
   }
-  else if (Or* val = dynamic_cast<Or*>(v.get())) {
+  else if (Or* val = value_cast<Or>(v.get())) {
     for (value arg : val->args) {
       get_var_index_transition_rec(groups, arg, vit);
     }
   }
-  else if (IfThenElse* val = dynamic_cast<IfThenElse*>(v.get())) {
+  else if (IfThenElse* val = value_cast<IfThenElse>(v.get())) {
     get_var_index_transition_rec(groups, val->cond, vit);
     get_var_index_transition_rec(groups, val->then_value, vit);
     get_var_index_transition_rec(groups, val->else_value, vit);
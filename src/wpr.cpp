@@ -46,19 +46,19 @@ value wpr(value v, shared_ptr<Action> a)
     return v_and(values);
   }
   else if (Assign* action = dynamic_cast<Assign*>(a.get())) {
-    Apply* apply = dynamic_cast<Apply*>(action->left.get());
+    Apply* apply = value_cast<Apply>(action->left.get());
     assert(apply != NULL);
 
     vector<VarDecl> decls;
     vector<value> eqs;
     vector<value> args;
 
-    Const* c = dynamic_cast<Const*>(apply->func.get());
+    Const* c = value_cast<Const>(apply->func.get());
     assert(c != NULL);
 
     for (int i = 0; i < (int)apply->args.size(); i++) {
       value arg = apply->args[i];
-      if (Var* arg_var = dynamic_cast<Var*>(arg.get())) {
+      if (Var* arg_var = value_cast<Var>(arg.get())) {
         args.push_back(arg);
         decls.push_back(VarDecl(arg_var->name, arg_var->sort));
       } else {